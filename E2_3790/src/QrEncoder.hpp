@@ -23,6 +23,17 @@
 #include "qrcode_convert.hpp"
 #include "utility.hpp"
 #include "crc32.hpp"
+#include "metrics.hpp"
+#include "frame.hpp"
+#include "manifest.hpp"
+#include "hash.hpp"
+#include "reassembly.hpp"
+#include "scheduler.hpp"
+#include "thread_pool.hpp"
+#include "preprocess.hpp"
+#include "decoder_chain.hpp"
+#include "fusion.hpp"
+#include "nack.hpp"
 
 #define forup(i, l, r) for (int i = l; i <= r; i++)
 #define fdown(i, l, r) for (int i = r; i >= l; i--)
@@ -49,222 +60,298 @@ using namespace std;
 using namespace qrcodegen;
 using namespace zbar;
 
+/// 生成二维码后的自检策略
+enum class VerifyPolicy
+{
+    // 不检查
+    OFF,
+    // 每隔若干张抽查一张
+    SAMPLED,
+    // 每一张都检查
+    FULL,
+};
+
 class QrEncoder
 {
 private:
-    // 二维码储存的数据
-    struct QrData
+    void debug_print_qrData(const QrData& qr_data)
     {
-        int index;
-        vector<uchar> data;
-        int len;
-        bool start;
-        bool end;
-
-        QrData()
-        {
-            index = 0;
-            start = false;
-            end = false;
-        }
-
-        QrData(vector<uchar>& serializedData)
-        {
-            deserialize(serializedData);
-        }
-
-        void deserialize(const vector<uchar>& serializedData)
-        {
-            size_t offset = 0;
+#ifdef DEBUG
+        cout << "index: " << qr_data.index << '\n'
+             << "len: " << qr_data.len << '\n'
+             << "start: " << (int)qr_data.start << '\n'
+             << "end: " << (int)qr_data.end << '\n';
+        for (uchar ch : qr_data.data) cout << (int)ch << ' '; cout << endl;
+#endif
+    }
 
-            for (int i = 0; i < 4; ++i)
-            {
-                index = (index << 8) | serializedData[offset++];
-            }
+    /// 切出文件的第index个分块
+    /// \param file_data
+    /// \param index 分块序号，从0开始
+    /// \param chunk_size 分块大小
+    /// \return
+    QrData make_chunk(const vector<uchar>& file_data, uint64_t index, uint32_t chunk_size)
+    {
+        QrData tmp = QrData();
+        tmp.index = index;
 
-            for (int i = 0; i < 4; ++i)
-            {
-                len = (len << 8) | serializedData[offset++];
-            }
+        uint64_t begin = index * chunk_size;
+        uint64_t end = min<uint64_t>(begin + chunk_size, file_data.size());
+        tmp.data = vector<uchar>(file_data.begin() + (long long)begin, file_data.begin() + (long long)end);
+        tmp.len = tmp.data.size();
+        tmp.start = index == 0;
+        tmp.end = end == file_data.size();
 
-            start = serializedData[offset++] == '1';
+        return tmp;
+    }
 
-            end = serializedData[offset++] == '1';
+    /// 帧序列化后转成二维码里实际存放的字节
+    /// \param frame
+    /// \return
+    vector<uchar> frame_to_symbol_payload(DataFrame& frame)
+    {
+        frame.generate_crc32();
+        vector<uchar> serialized_frame = frame.serialize();
+        if (options.binary) return serialized_frame;
+
+        // 为什么要用base64编码？
+        // 因为zbar检测二维码是按照utf-8编码读数据的，所以如果最高位是1，就会变成c2/c3开头的宽字符，为了避免，我们使用base64，即四个6位bit表示3个char
+        base64::Encoder b64_encoder = base64::Encoder();
+        return b64_encoder.base64_encode(serialized_frame);
+    }
 
-            data = vector<uchar>(serializedData.begin() + offset, serializedData.end());
-        }
-    };
+    /// 这一张二维码是否需要自检
+    /// \param symbol_index
+    /// \return
+    bool should_verify(size_t symbol_index) const
+    {
+#ifdef QRCODE_CHECK
+        if (options.verify == VerifyPolicy::FULL) return true;
+        if (options.verify == VerifyPolicy::SAMPLED) return symbol_index % max(1, options.verify_every) == 0;
+#endif
+        return false;
+    }
 
-    /// 帧格式
-    struct DataFrame
+    /// 用zbar重新识别生成的二维码，看读出来的和写进去的是否一致
+    /// \param image
+    /// \param payload 二维码里存放的字节
+    /// \return
+    static bool verify_symbol(const Mat& image, const vector<uchar>& payload)
     {
-        uint8_t begin{};
-        uint8_t destination{};
-        uint8_t source{};
-        uint16_t length;
+        metrics::StageTimer timer("verification");
         vector<uchar> data;
-        uint32_t crc{};
-
-        DataFrame() = default;
-
-        DataFrame(vector<uchar>& data, uint8_t source, uint8_t destination)
-        {
-            this->data = data;
-
-            this->source = source;
-            this->destination = destination;
-            this->length = this->data.size();
-            // 规定begin为0x7F，之所以前一个是7，是因为第一个位如果是1，转成char后就是负数，int类型下也是负数了
-            this->begin = (char)0x7F;
-        }
-
-        DataFrame(vector<uchar>& serializedData)
-        {
-            deserialize(serializedData);
-        }
+        metrics::global().add("symbols_verified");
+        return decode(image, data) && data == payload;
+    }
 
-        ///
-        /// \param serializedData
-        /// \return 返回1成功，返回-1表示length和data中有一个不对的
-        int deserialize(const vector<uchar>& serializedData)
+    /// 自检失败的二维码换更大的版本重新编码
+    /// libqrencode不能指定掩码，换版本后模块布局变了，掩码也会重新选择
+    /// 新版本的模块更多，按放得下的最大整数倍画，四周补白到原来的尺寸；不缩放，每个模块的宽度都一样
+    /// \param qrCode 成功时替换为新的二维码，原来的模块数据释放掉
+    /// \param payload
+    /// \param image 成功时替换为新的图像，尺寸和原来一致
+    /// \return 几个版本都识别不出来返回false
+    static bool reencode_symbol(QRcode& qrCode, const vector<uchar>& payload, Mat& image)
+    {
+        forup (version, qrCode.version + 1, min(40, qrCode.version + 3))
         {
-            size_t offset = 0;
-
-            begin = serializedData[offset++];
-            destination = serializedData[offset++];
-            source = serializedData[offset++];
-
-            for (int i = 1; i <= 2; ++i)
+            QRcode* candidate = QRcode_encodeData((int)payload.size(), payload.data(), version, QR_ECLEVEL_H);
+            if (candidate == nullptr) continue;
+
+            // 和qrCode_to_mat一样算上两边各5个模块的空白区
+            int scale = 10;
+            while (scale > 1 && (candidate->width + 10) * scale > min(image.cols, image.rows)) scale--;
+            Mat candidate_image = qrCode_to_mat(*candidate, scale);
+            if (candidate_image.cols > image.cols || candidate_image.rows > image.rows)
             {
-                length = (length << 8) | serializedData[offset++];
+                QRcode_free(candidate);
+                continue;
             }
+            int top = (image.rows - candidate_image.rows) / 2, left = (image.cols - candidate_image.cols) / 2;
+            copyMakeBorder(candidate_image, candidate_image, top, image.rows - candidate_image.rows - top,
+                           left, image.cols - candidate_image.cols - left, BORDER_CONSTANT, Scalar(255));
 
-            for (int i = 0; i < length; i++)
+            if (verify_symbol(candidate_image, payload))
             {
-                data.push_back(serializedData[offset++]);
-                if (offset >= serializedData.size())
-                {
-                    return -1;
-                }
+                // 新的换进来，原来的交给candidate一起释放
+                QRcode replaced = qrCode;
+                qrCode = *candidate;
+                *candidate = replaced;
+                QRcode_free(candidate);
+                image = candidate_image;
+                return true;
             }
+            QRcode_free(candidate);
+        }
+        return false;
+    }
 
-            for (int i = 1; i <= 4; ++i)
-            {
-                crc = (crc << 8) | serializedData[offset++];
-            }
+    /// 按选项中的帧格式生成数据帧
+    /// \param file_id
+    /// \param chunk
+    /// \return 二维码里存放的字节
+    vector<uchar> data_symbol_payload(uint32_t file_id, const QrData& chunk)
+    {
+        DataFrame frame = options.frame_version == 1 ?
+                          DataFrame(chunk.serialize(), file_id, 0) :
+                          DataFrame::compact(FRAME_DATA, file_id, chunk, !options.binary);
+        return frame_to_symbol_payload(frame);
+    }
 
-            return 1;
-        }
+    /// 轮播：已经画好的二维码循环排到视频结束，每隔manifest_interval张、每轮开头都重新插入清单
+    /// 重复的图片用硬链接，不支持时复制
+    /// \param qr_path 二维码图片文件夹
+    /// \param manifest_count 开头的清单帧张数
+    /// \param symbol_count 已经画好的张数
+    /// \param frame_amount 视频总帧数
+    /// \param image_extension
+    /// \return
+    bool extend_carousel(const string& qr_path, size_t manifest_count, size_t symbol_count, size_t frame_amount,
+                         const string& image_extension)
+    {
+        if (symbol_count <= manifest_count) return true;
 
-        uint32_t generate_crc32()
+        vector<size_t> order;
+        size_t next = manifest_count;
+        int since_manifest = 0;
+        while (symbol_count + order.size() < frame_amount)
         {
-            CRC32 generator = CRC32();
-            crc = generator.generate(data);
-            return crc;
+            if (since_manifest >= options.manifest_interval)
+            {
+                forup (i, 0, (int)manifest_count - 1) order.push_back(i);
+                since_manifest = 0;
+                continue;
+            }
+            order.push_back(next);
+            since_manifest++;
+            if (++next == symbol_count)
+            {
+                next = manifest_count;
+                since_manifest = options.manifest_interval;
+            }
         }
 
-        bool verify_crc32()
+        for (size_t k = 0; k < order.size(); k++)
         {
-            CRC32 verifier = CRC32();
-            return verifier.verify(data, crc);
+            fs::path source = fs::path(qr_path) / std::format("qrCode_{}.{}", order[k] + 1, image_extension);
+            fs::path target = fs::path(qr_path) / std::format("qrCode_{}.{}", symbol_count + k + 1, image_extension);
+            error_code error;
+            filesystem::create_hard_link(source, target, error);
+            if (error) filesystem::copy_file(source, target, filesystem::copy_options::overwrite_existing, error);
+            if (error) return false;
         }
-    };
+        metrics::global().add("carousel_repeats", order.size());
+        return true;
+    }
 
-    void debug_print_qrData(const QrData& qr_data)
+    /// 按选项中的帧格式生成清单帧或分块哈希帧
+    /// \param type
+    /// \param page 一页清单或分块哈希
+    /// \return 二维码里存放的字节
+    vector<uchar> control_symbol_payload(FrameType type, const vector<uchar>& page)
     {
-#ifdef DEBUG
-        cout << "index: " << qr_data.index << '\n'
-             << "len: " << qr_data.len << '\n'
-             << "start: " << (int)qr_data.start << '\n'
-             << "end: " << (int)qr_data.end << '\n';
-        for (uchar ch : qr_data.data) cout << (int)ch << ' '; cout << endl;
-#endif
+        QrData tmp = QrData();
+        tmp.data = page;
+        DataFrame frame = options.frame_version == 1 ?
+                          DataFrame(page, 0, 0, type) :
+                          DataFrame::compact(type, 0, tmp, !options.binary);
+        return frame_to_symbol_payload(frame);
     }
 
-    vector<uchar> serialize(const DataFrame& data)
+    /// 把一组二维码画成图片，自检后合成一个视频
+    /// \param symbols 这个视频里依次放哪几张二维码（qr_arr的下标）
+    /// \param qr_arr 自检失败重新编码的会被替换
+    /// \param payloads
+    /// \param manifest_count 开头的清单帧张数
+    /// \param frame_amount 视频总帧数
+    /// \param qr_path 存放二维码图片的临时文件夹
+    /// \param output_path 视频输出路径
+    /// \param duration 时长（s）
+    /// \param image_extension
+    /// \return
+    bool render_video(const vector<size_t>& symbols, vector<QRcode>& qr_arr, const vector<vector<uchar>>& payloads,
+                      size_t manifest_count, size_t frame_amount, const string& qr_path, const string& output_path,
+                      int duration, const string& image_extension)
     {
-        vector<uchar> serializedData;
-
-        serializedData.push_back(data.begin);
-        serializedData.push_back(data.destination);
-        serializedData.push_back(data.source);
+        // 创建存放二维码的临时文件夹
+        create_folder_of_work_folder(qr_path);
 
-        for (int i = 1; i >= 0; i--)
-            serializedData.push_back((data.length >> (i * 8)) & 0xFF);
+        // 自检在线程池里做，绘制不用等zbar
+        unique_ptr<ThreadPool> verify_pool;
+        mutex failures_mutex;
+        vector<int> failures;
+        if (should_verify(0)) verify_pool = make_unique<ThreadPool>();
 
-        serializedData.insert(serializedData.end(), data.data.begin(), data.data.end());
+        // 由QrCode转换为Mat后，由imwrite写入文件夹
+        for (int i = 0; i < symbols.size(); i++)
+        {
+#ifndef DEBUG
+            print_progress_bar(i, symbols.size() - 1, "二维码绘制中");
+#endif
+            metrics::StageTimer timer("rasterization");
+            QRcode qrCode = qr_arr[symbols[i]];
 
-        for (int i = 3; i >= 0; i--)
-            serializedData.push_back((data.crc >> (i * 8)) & 0xFF);
+            Mat input_image = qrCode_to_mat(qrCode, 10);
 
-        return serializedData;
-    }
+            string img_path = (fs::path(qr_path) / std::format("qrCode_{}.{}", i + 1, image_extension)).string();
 
-    vector<uchar> serialize(const QrData& qrData)
-    {
-        vector<uchar> serializedData;
+            if (!imwrite(img_path, input_image)) return false;
 
-        for (int i = 3; i >= 0; --i)
-        {
-            serializedData.push_back((qrData.index >> (i * 8)) & 0xFF); // 从高位字节到低位
+            if (verify_pool && should_verify(i))
+            {
+                verify_pool->submit([&, i, input_image]()
+                {
+                    if (verify_symbol(input_image, payloads[symbols[i]])) return;
+                    lock_guard<mutex> lock(failures_mutex);
+                    failures.push_back(i);
+                });
+            }
         }
+        if (verify_pool) verify_pool->wait();
+#ifndef DEBUG
+        print_progress_bar(1, 1, "二维码绘制完成\n");
+#endif
 
-        for (int i = 3; i >= 0; --i)
+        // 自检没通过的重新编码后覆盖原图，实在识别不出来的要提示
+        for (int i : failures)
         {
-            serializedData.push_back((qrData.len >> (i * 8)) & 0xFF); // 从高位字节到低位
-        }
-
-        serializedData.push_back(qrData.start ? '1' : '0');
-
-        serializedData.push_back(qrData.end ? '1' : '0');
+            metrics::global().add("verify_failures");
+            Mat input_image = qrCode_to_mat(qr_arr[symbols[i]], 10);
+            if (!reencode_symbol(qr_arr[symbols[i]], payloads[symbols[i]], input_image))
+            {
+                cout << "警告：" << output_path << "的第" << i + 1 << "张二维码自检失败，重新编码后仍无法识别" << endl;
+                continue;
+            }
+            metrics::global().add("symbols_reencoded");
 
-        serializedData.insert(serializedData.end(), qrData.data.begin(), qrData.data.end());
+            string img_path = (fs::path(qr_path) / std::format("qrCode_{}.{}", i + 1, image_extension)).string();
+            if (!imwrite(img_path, input_image)) return false;
+        }
 
-        return serializedData;
-    }
+        if (options.carousel && !extend_carousel(qr_path, manifest_count, symbols.size(), frame_amount, image_extension)) return false;
 
-    ///
-    /// \param output_file_path
-    /// \param output_data
-    void append_data(const string& output_file_path, vector<uchar>& output_data)
-    {
-        ofstream file = ofstream(output_file_path, ios::binary | ios::app);
-        file.write(reinterpret_cast<const char *>(output_data.data()), output_data.size());
+        {
+            metrics::StageTimer timer("video_sink");
+            ffmpeg::images_to_video(qr_path, output_path, duration);
+        }
 
-        file.close();
+        // 如果需要检查，要保留文件夹
+#ifndef DEBUG
+        // 合成视频后，二维码已经没用了
+        filesystem::remove_all(qr_path);
+#endif
+        return true;
     }
 
-    ///
-    /// \param uchar_vec
-    /// \param end_idx
-    /// \param data_len
-    /// \param ch_per_qr
+    /// 第k个条带的视频路径：只有一个条带时就是output_path，否则在文件名后加"_序号"
+    /// \param output_path
+    /// \param k 从0开始
     /// \return
-    vector<uchar> uchar_to_qrcode(vector<uchar>& uchar_vec, int end_idx, int ch_per_qr)
+    string stripe_output_path(const string& output_path, int k) const
     {
-        QrData tmp = QrData();
-        tmp.index = (end_idx - (ch_per_qr - 1)) / ch_per_qr + 1;
-
-        if (end_idx >= uchar_vec.size()) return {};
-        else if (end_idx + ch_per_qr >= uchar_vec.size())
-        {
-            tmp.data = vector<uchar>(uchar_vec.begin() + (end_idx - ch_per_qr), uchar_vec.end());
-            tmp.end = true;
-        }
-        else
-        {
-            tmp.data = vector<uchar>(uchar_vec.begin() + (end_idx - ch_per_qr + 1), uchar_vec.begin() + end_idx + 1);
-            if (end_idx == ch_per_qr - 1) tmp.start = true;
-        }
-
-        tmp.len = tmp.data.size();
-
-        vector<uchar> serialized_qr_data = serialize(tmp);
-
-        QrData deserialized_qr = QrData(serialized_qr_data);
-//        debug_print_qrData(deserialized_qr);
-
-        return serialized_qr_data;
+        if (options.stripes <= 1) return output_path;
+        fs::path path = output_path;
+        return (path.parent_path() / (path.stem().string() + std::format("_{}", k + 1) + path.extension().string())).string();
     }
 
     ///
@@ -280,6 +367,37 @@ private:
     }
 
 public:
+    /// 编解码选项
+    struct Options
+    {
+        // 生成二维码后的自检（需要define QRCODE_CHECK），在线程池里和绘制并行
+        VerifyPolicy verify = VerifyPolicy::SAMPLED;
+        // 抽查时每多少张查一张
+        int verify_every = 16;
+        // 轮播：编码端循环发送直到视频结束，解码端从任意位置开始接收
+        bool carousel = false;
+        // 轮播时每隔多少张重发一次清单
+        int manifest_interval = 100;
+        // 解码时的多帧融合方式
+        FusionMode fusion = FusionMode::MEDIAN;
+        // 帧格式版本：1为定长帧头，2为紧凑帧头（varint + flags），解码时两种都认
+        int frame_version = 2;
+        // 帧的二进制直接写进二维码，不做base64（需要ZBAR_BINARY），v2帧此时省略crc，靠二维码自身的纠错
+        bool binary = false;
+        // 多文件时的帧调度策略，默认小文件优先发完
+        SchedulePolicy schedule = SchedulePolicy::SHORTEST_REMAINING_FIRST;
+        // 文件名到优先级/权重的标注
+        map<string, FileTag> tags;
+        // 修复模式：非空时只编码这些缺失的分块
+        vector<nack::Range> repair;
+        // 解码后把缺失区间发到这里（文件路径或tcp:主机:端口），空则不发
+        string nack_target;
+        // 解码时接着输出目录里上一次的结果收，不清空输出目录
+        bool resume = false;
+        // 编码时把数据帧分到几个视频里，每个视频对应一块屏幕，同时播放
+        int stripes = 1;
+    } options;
+
     QrEncoder() = default;
 
     /// 编码生成二维码图集，随后把二维码合成为视频
@@ -294,7 +412,7 @@ public:
         // 毫秒转成秒
         duration /= 1000;
 
-        // 读入目标文件夹中所有bin文件（的路径）
+        // 读入目标文件夹中所有bin文件（的路径），排序后按顺序分配文件ID
         vector<fs::path> input_files;
         for (const auto& entry : fs::directory_iterator(input_folder))
         {
@@ -303,137 +421,341 @@ public:
                 input_files.push_back(entry.path());
             }
         }
+        sort(input_files.begin(), input_files.end());
 
-        // 将文件夹中的文件映射到对应的数据上
+        // 文件ID即下标
         size_t total_size = 0;
-        map<fs::path, vector<uchar>> input_file_vectors;
+        vector<vector<uchar>> input_file_vectors;
         for (auto& file : input_files)
         {
-            input_file_vectors[file] = file_to_vector(file.string());
-            total_size += input_file_vectors[file].size();
+            input_file_vectors.push_back(file_to_vector(file.string()));
+            total_size += input_file_vectors.back().size();
+        }
+
+        // 修复模式：只发NACK里缺失的分块，分块大小必须和原视频一致，分块序号才对得上
+        map<uint32_t, vector<uint64_t>> repair_chunks;
+        for (const nack::Range& range : options.repair)
+        {
+            if (range.file_id >= input_files.size() || range.chunk_size != options.repair.front().chunk_size)
+            {
+                cout << "NACK和输入文件对不上：文件" << range.file_id << endl;
+                return false;
+            }
+            vector<uint64_t>& chunks = repair_chunks[range.file_id];
+            for (uint64_t index = range.first; index < range.first + range.count; index++) chunks.push_back(index);
+        }
+        for (auto& [file_id, chunks] : repair_chunks)
+        {
+            sort(chunks.begin(), chunks.end());
+            chunks.erase(unique(chunks.begin(), chunks.end()), chunks.end());
         }
 
         int frame_amount = duration * fps;
         // 要生成的二维码
         vector<QRcode> qr_arr;
+        // 每张二维码里存放的字节，自检时用来比对
+        vector<vector<uchar>> payloads;
         // 二维码能携带的数据量是有限的，并且还要根据用户输入的帧大小进行限制
         int ch_per_qr = max(
             1,
             min(
-                (int)ceil(((float)total_size / (float)frame_amount)),
-                min(512, max_trans_unit - 9)
+                (int)ceil(((float)total_size / (float)(frame_amount * max(1, options.stripes)))),
+                min(512, max_trans_unit - (int)QrData::HEADER_SIZE)
                 )
             );
+        if (!options.repair.empty()) ch_per_qr = (int)options.repair.front().chunk_size;
         // 一个char是8b，一个kb就是128个char
         cout << "每张二维码携带的数据量：" << ch_per_qr * 8 << "B" <<endl;
-        int current_data_size = 0;
-        // 分时复用
-        for (int t = 0, i = ch_per_qr - 1; ; t++, i += ch_per_qr)
+
+        // 清单：文件ID、文件名、大小、分块大小、整个文件的crc32和分块哈希的Merkle根，放在最前面发送
+        // 接着发每个分块的XXH64，接收端不需要原文件就能逐块校验
+        // 修复时清单里只有要补的文件
+        vector<ManifestEntry> manifest;
+        map<uint32_t, vector<uint64_t>> block_hashes;
+        CRC32 crc = CRC32();
+        for (uint32_t file_id = 0; file_id < input_files.size(); file_id++)
+        {
+            if (!options.repair.empty() && !repair_chunks.contains(file_id)) continue;
+
+            ManifestEntry entry;
+            entry.file_id = file_id;
+            entry.name = input_files[file_id].filename().string();
+            entry.size = input_file_vectors[file_id].size();
+            entry.chunk_size = ch_per_qr;
+            entry.hash = crc.generate(input_file_vectors[file_id]);
+
+            vector<uint64_t> hashes;
+            for (uint64_t index = 0; index < entry.chunk_count(); index++)
+            {
+                hashes.push_back(hash64::xxh64(make_chunk(input_file_vectors[file_id], index, ch_per_qr).data));
+            }
+            entry.merkle_root = hash64::merkle_root(hashes);
+
+            if (!options.repair.empty() && repair_chunks[file_id].back() >= entry.chunk_count())
+            {
+                cout << "NACK和输入文件对不上：文件" << file_id << "没有第" << repair_chunks[file_id].back() << "块" << endl;
+                return false;
+            }
+
+            manifest.push_back(entry);
+            block_hashes[file_id] = hashes;
+        }
+
+        if (!options.repair.empty())
+        {
+            total_size = 0;
+            for (auto& [file_id, chunks] : repair_chunks)
+            {
+                for (uint64_t index : chunks) total_size += make_chunk(input_file_vectors[file_id], index, ch_per_qr).len;
+            }
+            cout << "修复模式：补发" << options.repair.size() << "段缺失的分块" << endl;
+        }
+
+        size_t control_payload = max<size_t>(ch_per_qr + QrData::HEADER_SIZE, 64);
+        vector<pair<FrameType, vector<uchar>>> control_pages;
+        for (const vector<uchar>& page : pack_manifest(manifest, control_payload))
+        {
+            control_pages.emplace_back(FRAME_MANIFEST, page);
+        }
+        size_t manifest_count = control_pages.size();
+        for (const ManifestEntry& entry : manifest)
+        {
+            // 修复时只发缺失区间的哈希
+            const vector<uint64_t>& hashes = block_hashes[entry.file_id];
+            vector<nack::Range> spans = { { entry.file_id, entry.chunk_size, 0, hashes.size() } };
+            if (!options.repair.empty())
+            {
+                spans.clear();
+                ranges::copy_if(options.repair, back_inserter(spans),
+                                [&](const nack::Range& range) { return range.file_id == entry.file_id; });
+            }
+            for (const nack::Range& span : spans)
+            {
+                vector<uint64_t> slice(hashes.begin() + (long long)span.first, hashes.begin() + (long long)(span.first + span.count));
+                for (const vector<uchar>& page : pack_block_hashes(entry.file_id, slice, control_payload, span.first))
+                {
+                    control_pages.emplace_back(FRAME_HASHES, page);
+                }
+            }
+        }
+
+        for (auto& [type, page] : control_pages)
+        {
+            vector<uchar> serialized_frame = control_symbol_payload(type, page);
+
+            metrics::StageTimer timer("symbol_generation");
+            qr_arr.push_back(*QRcode_encodeData((int)serialized_frame.size(), serialized_frame.data(), 0, QR_ECLEVEL_H));
+            payloads.push_back(serialized_frame);
+            metrics::global().add(type == FRAME_MANIFEST ? "manifest_symbols" : "hash_symbols");
+        }
+
+        // 由调度器决定分块的发送顺序
+        unique_ptr<FrameScheduler> scheduler = make_scheduler(options.schedule);
+        for (const ManifestEntry& entry : manifest)
+        {
+            auto tag = options.tags.find(entry.name);
+            uint64_t chunk_count = options.repair.empty() ? entry.chunk_count() : repair_chunks[entry.file_id].size();
+            scheduler->add_file(entry.file_id, chunk_count, tag == options.tags.end() ? FileTag() : tag->second);
+        }
+
+        uint64_t current_data_size = 0;
+        uint32_t file_id = 0;
+        uint64_t index = 0;
+        while (scheduler->next(file_id, index))
         {
 #ifndef DEBUG
             print_progress_bar(current_data_size, total_size, "二维码编码中");
 #endif
-            // 是否所有的数据都处理完毕
-            bool flag = false;
-            for (auto& [file_path, file_data] : input_file_vectors)
+            vector<uchar> serialized_frame;
             {
-                // 生成载荷部分
-                vector<uchar> qr_data = uchar_to_qrcode(input_file_vectors[file_path], i, ch_per_qr);
-                if (qr_data.empty()) continue;
-                current_data_size += qr_data.size() - 10;
+                metrics::StageTimer timer("chunking");
 
-                flag = true;
+                // 生成载荷部分，修复时调度器给出的是缺失列表里的第几个
+                uint64_t chunk_index = options.repair.empty() ? index : repair_chunks[file_id][index];
+                QrData chunk = make_chunk(input_file_vectors[file_id], chunk_index, ch_per_qr);
+                current_data_size += chunk.len;
+                metrics::global().add("bytes_encoded", chunk.len);
 
                 // 生成帧
-                DataFrame data_frame = DataFrame(qr_data, (uint8_t)stoi(file_path.stem().string()), 0);
-                data_frame.generate_crc32();
-
-                vector<uchar> serialized_frame = serialize(data_frame);
-                // 为什么要用base64编码？
-                // 因为zbar检测二维码是按照utf-8编码读数据的，所以如果最高位是1，就会变成c2/c3开头的宽字符，为了避免，我们使用base64，即四个6位bit表示3个char
-                base64::Encoder b64_encoder = base64::Encoder();
-                serialized_frame = b64_encoder.base64_encode(serialized_frame);
+                serialized_frame = data_symbol_payload(file_id, chunk);
+            }
 
-                QRcode qrCode = *QRcode_encodeData((int)serialized_frame.size(), serialized_frame.data(), 0, QR_ECLEVEL_H);
+            metrics::StageTimer timer("symbol_generation");
+            QRcode qrCode = *QRcode_encodeData((int)serialized_frame.size(), serialized_frame.data(), 0, QR_ECLEVEL_H);
 
-                qr_arr.push_back(qrCode);
+            qr_arr.push_back(qrCode);
+            payloads.push_back(serialized_frame);
+            metrics::global().add("symbols_encoded");
 
-                // 测试识别二维码得到的帧数据是否一致
+            // 测试识别二维码得到的帧数据是否一致
 #ifdef DEBUG
-                Mat input_image = qrCode_to_mat(qrCode, 10);
-                vector<uchar> tmp;
-                decode(input_image, tmp);
+            Mat input_image = qrCode_to_mat(qrCode, 10);
+            vector<uchar> tmp;
+            decode(input_image, tmp);
+            if (!options.binary)
+            {
                 base64::Decoder b64_decoder = base64::Decoder();
                 serialized_frame = b64_decoder.base64_decode(serialized_frame);
                 tmp = b64_decoder.base64_decode(tmp);
-                cout << "编码前字符串: "; for (auto ch : serialized_frame) cout << (int)ch << ' '; cout <<endl;
-                cout << "解码后字符串: "; for (auto ch : tmp) cout << (int)ch << ' '; cout <<endl;
-                DataFrame frame = DataFrame(tmp);
-                cout << "二维码解码后" << hex << frame.crc << endl;
-#endif
             }
-
-            if (!flag) break;
+            cout << "编码前字符串: "; for (auto ch : serialized_frame) cout << (int)ch << ' '; cout <<endl;
+            cout << "解码后字符串: "; for (auto ch : tmp) cout << (int)ch << ' '; cout <<endl;
+            DataFrame frame = DataFrame(tmp);
+            cout << "二维码解码后" << hex << frame.crc << endl;
+#endif
         }
 
 #ifndef DEBUG
         print_progress_bar(1, 1, "二维码编码完成\n");
 #endif
 
-        // 创建存放二维码的临时文件夹
-        string qr_path = "qrCodes";
-        create_folder_of_work_folder(qr_path);
+        // 条带：数据帧轮流分到各个视频，每个视频开头都带完整的清单和分块哈希，可以单独接收
+        int stripe_count = max(1, options.stripes);
+        vector<vector<size_t>> stripes(stripe_count);
+        for (size_t i = 0; i < qr_arr.size(); i++)
+        {
+            if (i < control_pages.size())
+            {
+                for (vector<size_t>& stripe : stripes) stripe.push_back(i);
+            }
+            else
+            {
+                stripes[(i - control_pages.size()) % stripe_count].push_back(i);
+            }
+        }
 
-        // 由QrCode转换为Mat后，由imwrite写入文件夹
-        for (int i = 0; i < qr_arr.size(); i++)
+        for (int k = 0; k < stripe_count; k++)
         {
-#ifndef DEBUG
-            print_progress_bar(i, qr_arr.size() - 1, "二维码绘制中");
-#endif
-            QRcode qrCode = qr_arr[i];
+            // 每个视频用自己的临时文件夹
+            string qr_path = stripe_count == 1 ? string("qrCodes") : std::format("qrCodes_{}", k + 1);
+            if (!render_video(stripes[k], qr_arr, payloads, manifest_count, frame_amount, qr_path,
+                              stripe_output_path(output_path, k), duration, image_extension)) return false;
+        }
 
-            Mat input_image = qrCode_to_mat(qrCode, 10);
+        return true;
+    }
 
-            vector<uchar> data;
-            decode(input_image, data);
+    /// 解码对应视频，输出文件和解码信息
+    /// \param input_video_path 输入文件路径
+    /// \param output_info_directory 输出目录，文件按清单中的文件名还原
+    /// \param origin_file_path 原文件目录，用于比较解码准确性
+    /// \return
+    bool decode(string& input_video_path, string& output_info_directory, string& origin_file_path, const string& image_extension = string("jpg"))
+    {
+        return decode(vector<string>{ input_video_path }, output_info_directory, origin_file_path, image_extension);
+    }
 
-#ifdef DEBUG
-            for (auto ch : data) cout << ch << ' '; cout << endl;
-#endif
+    /// 同时解码多个录像（条带编码时每块屏幕一个），各自一个线程，收到的分块合并到同一个reassembler
+    /// \param input_video_paths 输入文件路径
+    /// \param output_info_directory 输出目录，文件按清单中的文件名还原
+    /// \param origin_file_path 原文件目录，用于比较解码准确性
+    /// \return
+    bool decode(const vector<string>& input_video_paths, string& output_info_directory, string& origin_file_path,
+                const string& image_extension = string("jpg"))
+    {
+        if (input_video_paths.empty()) return false;
 
-            string img_path = qr_path + std::format("\\qrCode_{}.{}", i + 1, image_extension);
+        // 每个录像拆帧用自己的临时文件夹
+        vector<string> tmp_frame_folders;
+        for (size_t k = 0; k < input_video_paths.size(); k++)
+        {
+            tmp_frame_folders.push_back(input_video_paths.size() == 1 ? string("tmp_frames") : std::format("tmp_frames_{}", k + 1));
+            create_folder_of_work_folder(tmp_frame_folders.back());
+        }
+        if (!options.resume) create_folder_of_work_folder(output_info_directory);
+        else filesystem::create_directories(output_info_directory);
 
-            if (!imwrite(img_path, input_image)) return false;
+        // 轮播时不用等start分块，从录像的任意位置开始接收；修复视频里也不一定有start分块
+        Reassembler reassembler = Reassembler(output_info_directory, !options.carousel && !options.resume, options.resume);
+        if (input_video_paths.size() == 1)
+        {
+            decode_video(input_video_paths[0], tmp_frame_folders[0], reassembler, image_extension);
+        }
+        else
+        {
+            // 进度条只显示第一个录像的，几个线程一起刷会乱
+            vector<thread> workers;
+            for (size_t k = 0; k < input_video_paths.size(); k++)
+            {
+                workers.emplace_back([&, k]()
+                {
+                    decode_video(input_video_paths[k], tmp_frame_folders[k], reassembler, image_extension, k == 0);
+                });
+            }
+            for (thread& worker : workers) worker.join();
         }
-#ifndef DEBUG
-        print_progress_bar(1, 1, "二维码绘制完成\n");
-#endif
 
-        ffmpeg::images_to_video(qr_path, output_path, duration);
+        metrics::global().add("gaps", reassembler.missing_chunks());
+        reassembler.finish();
+
+        // 把缺失区间发回编码端，编码端据此生成修复视频
+        if (!options.nack_target.empty())
+        {
+            vector<nack::Range> missing = reassembler.nack_ranges();
+            if (reassembler.get_files().empty()) cout << "没有收到任何清单或分块，无法生成NACK" << endl;
+            else if (!nack::send(options.nack_target, missing)) cout << "NACK发送失败：" << options.nack_target << endl;
+            else cout << "已发送NACK：" << missing.size() << "段，共" << reassembler.missing_chunks() << "块" << endl;
+            metrics::global().add("nack_ranges", missing.size());
+        }
+
+        // 录像的帧率，用来把收齐时的帧号换算成时间
+        double video_fps = VideoCapture(input_video_paths[0]).get(CAP_PROP_FPS);
+
+        for (auto& [file_id, state] : reassembler.get_files())
+        {
+            fs::path output_path = reassembler.output_path(state);
+            string name = output_path.filename().string();
+            string stem = output_info_directory + "/" + output_path.stem().string();
+
+            // 逐块校验的结果写到.map，不需要原文件
+            reassembler.write_block_map(state, stem + ".map");
+            string block_map = reassembler.block_map(state);
+            metrics::global().add("hash_mismatches", state.hash_failures);
+
+            cout << fixed << setprecision(2) << name << "：分块校验通过" << ranges::count(block_map, 'V') << '/' << block_map.size();
+            if (ranges::count(block_map, 'X')) cout << "，坏块" << ranges::count(block_map, 'X');
+            if (reassembler.merkle_verified(state)) cout << "，Merkle根一致";
+
+            // 给了原文件目录时才和原文件逐位比较
+            if (!origin_file_path.empty())
+            {
+                double percentage = compare_difference(origin_file_path + "/" + name, output_path.string(), stem + ".val") * 100;
+                cout << "，传输正确率：" << percentage << '%';
+            }
+            if (state.has_manifest) cout << (state.verified ? "，crc32校验通过" : "，crc32校验失败");
+            if (state.completed_frame < 0)
+            {
+                cout << "，未收齐";
+            }
+            else
+            {
+                cout << "，第" << state.completed_frame << "帧收齐";
+                if (video_fps > 0) cout << "（" << state.completed_frame / video_fps << "秒）";
+            }
+            cout << endl;
+        }
 
-        // 如果需要检查，要保留文件夹
 #ifndef DEBUG
-        // 合成视频后，二维码已经没用了
-        filesystem::remove_all(qr_path);
+        for (const string& tmp_frame_folder : tmp_frame_folders) filesystem::remove_all(tmp_frame_folder);
 #endif
 
         return true;
     }
 
-    /// 解码对应视频，输出文件和解码信息
-    /// \param input_video_path 输入文件路径
-    /// \param output_file_path 输出文件路径
-    /// \param decode_info_path 解码信息输出路径
-    /// \return
-    bool decode(string& input_video_path, string& output_info_directory, string& origin_file_path, const string& image_extension = string("jpg"))
+    /// 把视频拆成帧，逐帧识别，识别出的清单和分块交给reassembler
+    /// \param input_video_path 输入视频路径
+    /// \param tmp_frame_folder 存放拆出的帧的临时文件夹
+    /// \param reassembler 多个录像同时解码时共用
+    /// \param show_progress 是否显示进度条
+    void decode_video(const string& input_video_path, string tmp_frame_folder, Reassembler& reassembler,
+                      const string& image_extension = string("jpg"), bool show_progress = true)
     {
-        string tmp_frame_folder = "tmp_frames";
-        create_folder_of_work_folder(tmp_frame_folder);
-        create_folder_of_work_folder(output_info_directory);
-
-        if (origin_file_path.empty()) origin_file_path = output_info_directory;
+        {
+            metrics::StageTimer timer("video_split");
+            ffmpeg::video_to_images(input_video_path, tmp_frame_folder);
+        }
 
-        ffmpeg::video_to_images(input_video_path, tmp_frame_folder);
+        metrics::PipelineMetrics& stats = metrics::global();
 
         int file_count = 0;
         for (const auto& entry : filesystem::directory_iterator(tmp_frame_folder))
@@ -444,109 +766,200 @@ public:
             }
         }
 
-        // 这里把每一张二维码的结果都单独存放在vector中
-        Mat* previous_img = nullptr;
-        QrData encoded_data;
-        map<uint8_t, QrData> previous_data;
-        set<uint8_t> data_start;
+        // 识别不出来时依次尝试二值化、CLAHE、锐化，顺序随成功次数调整
+        PreprocessCascade cascade;
+        // zbar识别不出来时再换别的识别器
+        DecoderChain decoders;
+        // 单帧都识别不出来时把同一张二维码的几帧叠加起来再试
+        FrameFusion fusion(options.fusion);
+
+        Mat previous_img;
         for (int i = 1; i <= file_count; i++)
         {
 #ifndef DEBUG
-            print_progress_bar(i, file_count, "二维码解码中");
+            if (show_progress) print_progress_bar(i, file_count, "二维码解码中");
 #endif
-            string img = std::format("\\frame_{:05d}.{}", i, image_extension);
+            string img_path = (fs::path(tmp_frame_folder) / std::format("frame_{:05d}.{}", i, image_extension)).string();
 #ifdef DEBUG
-            cout << img << endl;
+            cout << img_path << endl;
 #endif
 
-            string img_path = tmp_frame_folder + img;
             if (!filesystem::exists(img_path)) break;
 
-            Mat mat = imread(img_path);
+            Mat mat;
+            {
+                metrics::StageTimer timer("frame_read");
+                mat = imread(img_path);
+            }
+            stats.add("frames_read");
+
             // 重帧
-            if (previous_img && are_images_identical(*previous_img, mat)) continue;
+            if (!previous_img.empty() && are_images_identical(previous_img, mat))
+            {
+                stats.add("duplicates_skipped");
+                continue;
+            }
+            previous_img = mat;
 
-            mat = convert_to_gray(mat);
+            Mat gray = convert_to_gray(mat);
 
             // 解码得帧数据
             vector<uchar> current_frame_data_string;
-            decode(mat, current_frame_data_string);
+            {
+                metrics::StageTimer timer("scan");
+                PreprocessStep step = cascade.run(gray, [&](const Mat& image)
+                {
+                    return decoders.decode_primary(image, current_frame_data_string);
+                });
+                if (step == PREPROCESS_STEP_COUNT) decoders.decode_fallback(gray, current_frame_data_string);
+            }
 
-            // 没收到数据
-            if (current_frame_data_string.empty()) continue;
+            if (!current_frame_data_string.empty())
+            {
+                fusion.reset();
+            }
+            else
+            {
+                fusion.set_roi(decoders.last_location());
+                if (fusion.add(gray) >= 2 && decoders.decode_transformed(fusion.fuse(), fusion.canvas_to_image(), current_frame_data_string))
+                {
+                    stats.add("fusion_hits");
+                    fusion.reset();
+                }
+            }
 
-            base64::Decoder b64_decoder = base64::Decoder();
-            current_frame_data_string = b64_decoder.base64_decode(current_frame_data_string);
-            DataFrame current_frame_data = DataFrame(current_frame_data_string);
+            // 没收到数据
+            if (current_frame_data_string.empty())
+            {
+                stats.add("zbar_misses");
+                continue;
+            }
 
-            // crc检验有误
-            if (!current_frame_data.verify_crc32()) continue;
-            // 长度和数据的大小中有一个不一样
-            if (current_frame_data.length != current_frame_data.data.size()) continue;
+            // 帧起始字节不在base64字符表里：以它开头的是二进制传输，否则按base64解
+            uint8_t first_byte = current_frame_data_string[0];
+            bool base64_frame = first_byte != FRAME_BEGIN_V1 && first_byte != FRAME_BEGIN_V2 && first_byte != FRAME_BEGIN_LEGACY;
+            if (base64_frame)
+            {
+                metrics::StageTimer timer("base64");
+                base64::Decoder b64_decoder = base64::Decoder();
+                // base64长度必为4的倍数
+                if (current_frame_data_string.size() % 4 == 0)
+                {
+                    current_frame_data_string = b64_decoder.base64_decode(current_frame_data_string);
+                }
+                else
+                {
+                    current_frame_data_string.clear();
+                }
+            }
+            if (current_frame_data_string.size() < DataFrame::MIN_SIZE)
+            {
+                stats.add("base64_failures");
+                continue;
+            }
 
-            QrData current_qr_data = QrData(current_frame_data.data);
+            metrics::StageTimer verify_timer("verify");
+            DataFrame current_frame_data = DataFrame();
+            int res = current_frame_data.deserialize(current_frame_data_string);
 
-//            debug_print_qrData(current_qr_data);
+            // 不认识的帧头
+            if (res == -2)
+            {
+                stats.add("unknown_frames");
+                continue;
+            }
+            // 长度和数据的大小中有一个不一样
+            if (res == -1 || current_frame_data.length != current_frame_data.data.size())
+            {
+                stats.add("length_mismatches");
+                continue;
+            }
+            // crc检验有误；base64传输的帧编码时一定带crc，没带说明flags里的CRC位传错了
+            if (!current_frame_data.verify_crc32() || (base64_frame && !current_frame_data.has_crc()))
+            {
+                stats.add("crc_failures");
+                continue;
+            }
+            // 软判决解出的帧没有crc时只收有分块哈希可对的数据帧，清单和哈希帧不收
+            bool soft_unverified = decoders.last_hit_soft() && !current_frame_data.has_crc();
+            if (soft_unverified && current_frame_data.type != FRAME_DATA)
+            {
+                stats.add("soft_unverified");
+                continue;
+            }
 
-            // 数据接收开始
-            if (!data_start.contains(current_frame_data.source))
+            // 清单帧
+            if (current_frame_data.type == FRAME_MANIFEST)
             {
-                if (current_qr_data.start)
-                {
-                    data_start.insert(current_frame_data.source);
-                } else
+                vector<ManifestEntry> entries;
+                uint32_t total_files = 0;
+                if (!unpack_manifest(current_frame_data.data, entries, total_files))
                 {
+                    stats.add("manifest_failures");
                     continue;
                 }
+                reassembler.on_manifest_total(total_files);
+                for (const ManifestEntry& entry : entries)
+                {
+                    reassembler.on_manifest(entry);
+                }
+                stats.add("manifest_frames");
+                continue;
             }
 
-            // 二维码数据序号一样，重复
-            if (!previous_data[current_frame_data.source].data.empty() &&
-                 previous_data[current_frame_data.source].index == current_qr_data.index) continue;
-
-            // 有中间二维码没识别出来
-            if (!previous_data[current_frame_data.source].data.empty() &&
-                 previous_data[current_frame_data.source].index + 1 < current_qr_data.index)
+            // 分块哈希帧
+            if (current_frame_data.type == FRAME_HASHES)
             {
-                forup (k, 1, current_qr_data.index - previous_data[current_frame_data.source].index - 1)
+                BlockHashPage page;
+                if (!unpack_block_hashes(current_frame_data.data, page))
                 {
-                    QrData recovery_qrcode = QrData();
-                    recovery_qrcode.index = previous_data[current_frame_data.source].index + k;
-                    recovery_qrcode.data = vector<uchar>(previous_data[current_frame_data.source].len, 'a');
-                    append_data(output_info_directory + std::format("{:d}.bin", (int)current_frame_data.source), recovery_qrcode.data);
+                    stats.add("hash_frame_failures");
+                    continue;
                 }
+                reassembler.on_block_hashes(page);
+                stats.add("hash_frames");
+                continue;
             }
 
-            encoded_data = current_qr_data;
-
-            append_data(output_info_directory + std::format("/{:d}.bin", (int)current_frame_data.source), encoded_data.data);
-
-            previous_img = &mat;
-            previous_data[current_frame_data.source] = current_qr_data;
+            QrData current_qr_data = QrData();
+            if (!current_frame_data.to_chunk(current_qr_data))
+            {
+                stats.add("length_mismatches");
+                continue;
+            }
 
-            // 数据接收结束
-            if (current_qr_data.end) break;
-        }
+            if (soft_unverified && !reassembler.block_hash_known(current_frame_data.source, current_qr_data.index))
+            {
+                stats.add("soft_unverified");
+                continue;
+            }
 
+            debug_print_qrData(current_qr_data);
 
-#ifndef DEBUG
-        print_progress_bar(1, 1, "二维码解码完成\n");
-#endif
+            verify_timer.stop();
+            metrics::StageTimer write_timer("write");
 
-        for (char source : data_start)
-        {
-            double percentage = compare_difference(origin_file_path + std::format("/{:d}.bin", (int)source), output_info_directory + std::format("/{:d}.bin", (int)source),
-                                                   output_info_directory + std::format("/{:d}.val", (int)source)) * 100;
+            // 重复的或还没开始接收的分块会被忽略
+            if (reassembler.on_chunk(current_frame_data.source, current_qr_data, i))
+            {
+                stats.add("bytes_written", current_qr_data.data.size());
+            }
+            else
+            {
+                stats.add("chunks_ignored");
+            }
 
-            cout << fixed << setprecision(2) << std::format("{:d}.bin", (int)source) << "文件传输正确率：" << percentage << '%' << endl;
+            // 清单里的文件全部收齐
+            if (reassembler.complete()) break;
         }
 
-
 #ifndef DEBUG
-        filesystem::remove_all(tmp_frame_folder);
+        if (show_progress) print_progress_bar(1, 1, "二维码解码完成\n");
 #endif
-
-        return true;
+        // 几个录像的统计依次输出，不要交错
+        static mutex report_mutex;
+        lock_guard<mutex> lock(report_mutex);
+        decoders.print_report();
     }
 
     /// 识别二维码，输出得到的数据
@@ -556,31 +969,7 @@ public:
     /// \return
     static bool decode(const Mat& input_image, vector<uchar>& output_data)
     {
-        ImageScanner scanner;
-        scanner.set_config(ZBAR_QRCODE, ZBAR_CFG_ENABLE, 1);
-        Image zbar_image(input_image.cols, input_image.rows, "Y800", input_image.data, input_image.cols * input_image.rows);
-        int res = scanner.scan(zbar_image);
-        if (res == 0) return false;
-
-        vector<unsigned char> data;
-
-        for (Image::SymbolIterator symbol = zbar_image.symbol_begin(); symbol != zbar_image.symbol_end(); ++symbol)
-        {
-            const string& symbolData = symbol->get_data();
-
-            for (unsigned char ch : symbolData)
-            {
-                data.push_back(ch);
-            }
-        }
-
-#ifdef DEBUG
-//        cout << "decode: 识别得到的二维码数据：";
-//        for (char ch : data) cout << hex << (uint32_t)ch << ' '; cout << endl;
-#endif
-
-        output_data.insert(output_data.end(), data.begin(), data.end());
-
-        return true;
+        ZbarBackend zbar_backend;
+        return zbar_backend.decode(input_image, output_data);
     }
 };
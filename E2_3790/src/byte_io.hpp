@@ -0,0 +1,171 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+using namespace std;
+
+/// 大端序写入，帧头/清单共用
+class ByteWriter
+{
+public:
+    explicit ByteWriter(vector<unsigned char>& output) : output(output) {}
+
+    void put_u8(uint8_t value)
+    {
+        output.push_back(value);
+    }
+
+    void put_u16(uint16_t value)
+    {
+        put_be(value, 2);
+    }
+
+    void put_u32(uint32_t value)
+    {
+        put_be(value, 4);
+    }
+
+    void put_u64(uint64_t value)
+    {
+        put_be(value, 8);
+    }
+
+    void put_bytes(const unsigned char* data, size_t size)
+    {
+        output.insert(output.end(), data, data + size);
+    }
+
+    void put_bytes(const vector<unsigned char>& data)
+    {
+        output.insert(output.end(), data.begin(), data.end());
+    }
+
+    /// LEB128变长整数，每字节7位，最高位表示后面还有
+    void put_varint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            output.push_back((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        output.push_back(value);
+    }
+
+    void put_string(const string& text)
+    {
+        put_u16((uint16_t)text.size());
+        output.insert(output.end(), text.begin(), text.end());
+    }
+
+private:
+    void put_be(uint64_t value, int bytes)
+    {
+        fdown (i, 0, bytes - 1)
+        {
+            output.push_back((value >> (i * 8)) & 0xFF);
+        }
+    }
+
+    vector<unsigned char>& output;
+};
+
+/// 大端序读取，越界后ok()为false，之后读出的值都是0
+class ByteReader
+{
+public:
+    ByteReader(const vector<unsigned char>& input, size_t offset = 0) : input(input), offset(offset) {}
+
+    uint8_t get_u8()
+    {
+        return (uint8_t)get_be(1);
+    }
+
+    uint16_t get_u16()
+    {
+        return (uint16_t)get_be(2);
+    }
+
+    uint32_t get_u32()
+    {
+        return (uint32_t)get_be(4);
+    }
+
+    uint64_t get_u64()
+    {
+        return get_be(8);
+    }
+
+    uint64_t get_varint()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (!require(1)) return 0;
+            uint8_t byte = input[offset++];
+            value |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        // 超过10个字节，格式有误
+        good = false;
+        return 0;
+    }
+
+    vector<unsigned char> get_bytes(size_t size)
+    {
+        if (!require(size)) return {};
+        vector<unsigned char> res(input.begin() + (long)offset, input.begin() + (long)(offset + size));
+        offset += size;
+        return res;
+    }
+
+    string get_string()
+    {
+        uint16_t size = get_u16();
+        if (!require(size)) return {};
+        string res(input.begin() + (long)offset, input.begin() + (long)(offset + size));
+        offset += size;
+        return res;
+    }
+
+    bool ok() const
+    {
+        return good;
+    }
+
+    size_t position() const
+    {
+        return offset;
+    }
+
+    size_t remaining() const
+    {
+        return good ? input.size() - offset : 0;
+    }
+
+private:
+    bool require(size_t size)
+    {
+        if (!good || input.size() - offset < size) good = false;
+        return good;
+    }
+
+    uint64_t get_be(int bytes)
+    {
+        if (!require(bytes)) return 0;
+        uint64_t value = 0;
+        forup (i, 1, bytes)
+        {
+            value = (value << 8) | input[offset++];
+        }
+        return value;
+    }
+
+    const vector<unsigned char>& input;
+    size_t offset;
+    bool good = true;
+};
@@ -0,0 +1,332 @@
+// 屏幕-摄像头信道模拟器
+// 读入encode生成的视频，按固定顺序施加参数化的退化：
+// 透视变换 -> 失焦/运动模糊 -> gamma/暗角 -> 传感器噪声 -> 卷帘快门混叠 -> 帧率重采样 -> JPEG/H.264重编码
+// 然后调用解码器，按退化强度输出有效吞吐量(goodput)和误码率(BER)曲线
+// 指令格式：channel_simulator <编码视频> <原文件目录> <输出csv> [--severity 0,0.25,0.5,0.75,1] [其余参数见ChannelParams]
+#include "../QrEncoder.hpp"
+
+#include <bit>
+#include <fstream>
+#include <random>
+
+/// 退化强度为1时的信道参数，强度s时线性缩放为s倍（帧率、编码质量等不缩放的参数除外）
+struct ChannelParams
+{
+    // 四个角的最大随机偏移，占图像边长的比例
+    double perspective = 0.04;
+    // 失焦模糊的高斯sigma（像素）
+    double defocus = 1.5;
+    // 运动模糊的长度（像素）和方向（度）
+    double motion_length = 6;
+    double motion_angle = 30;
+    // gamma的偏离量，实际gamma为1+gamma
+    double gamma = 0.6;
+    // 暗角强度，边角亮度衰减为1-vignette
+    double vignette = 0.5;
+    // 读出噪声的标准差和散粒噪声系数（灰度0~255）
+    double read_noise = 8;
+    double shot_noise = 0.3;
+    // 逐行读出耗时占一帧时长的比例，0为全局快门
+    double rolling_shutter = 0.8;
+    // 曝光时长占一帧时长的比例，跨越屏幕刷新时会混叠两帧
+    double exposure = 0.5;
+
+    // 以下参数不随强度缩放
+    double display_fps = 10;
+    double camera_fps = 30;
+    int jpeg_quality = 85;
+    int crf = 28;
+    unsigned seed = 3790;
+
+    ChannelParams scaled(double severity) const
+    {
+        ChannelParams res = *this;
+        res.perspective *= severity;
+        res.defocus *= severity;
+        res.motion_length *= severity;
+        res.gamma *= severity;
+        res.vignette *= severity;
+        res.read_noise *= severity;
+        res.shot_noise *= severity;
+        res.rolling_shutter *= severity;
+        res.exposure *= severity;
+        return res;
+    }
+};
+
+/// 透视变换，模拟手机没有正对屏幕
+Mat apply_perspective(const Mat& src, double amount, mt19937& rng)
+{
+    if (amount <= 0) return src;
+
+    uniform_real_distribution<float> jitter(-1, 1);
+    auto w = (float)src.cols, h = (float)src.rows;
+    float dx = (float)amount * w, dy = (float)amount * h;
+
+    Point2f from[4] = { {0, 0}, {w, 0}, {w, h}, {0, h} };
+    Point2f to[4];
+    forup (i, 0, 3)
+    {
+        to[i] = from[i] + Point2f(jitter(rng) * dx, jitter(rng) * dy);
+    }
+
+    Mat dst;
+    warpPerspective(src, dst, getPerspectiveTransform(from, to), src.size(), INTER_LINEAR, BORDER_CONSTANT, Scalar(255));
+    return dst;
+}
+
+/// 失焦（高斯）和运动模糊（线段卷积核）
+Mat apply_blur(const Mat& src, double defocus, double motion_length, double motion_angle)
+{
+    Mat dst = src;
+    if (defocus > 0)
+    {
+        GaussianBlur(dst, dst, Size(0, 0), defocus);
+    }
+
+    int length = (int)round(motion_length);
+    if (length > 1)
+    {
+        Mat kernel = Mat::zeros(length, length, CV_32F);
+        Point2f center((float)(length - 1) / 2, (float)(length - 1) / 2);
+        double rad = motion_angle * CV_PI / 180;
+        Point2f dir((float)cos(rad), (float)sin(rad));
+        line(kernel, center - dir * (float)length / 2, center + dir * (float)length / 2, Scalar(1));
+        kernel /= sum(kernel)[0];
+        filter2D(dst, dst, -1, kernel);
+    }
+    return dst;
+}
+
+/// gamma失真和径向暗角
+Mat apply_photometric(const Mat& src, double gamma, double vignette)
+{
+    Mat dst;
+    pow(src / 255.0, 1 + gamma, dst);
+    dst *= 255.0;
+
+    if (vignette > 0)
+    {
+        Mat falloff(src.size(), CV_32F);
+        float cx = (float)src.cols / 2, cy = (float)src.rows / 2;
+        float max_r2 = cx * cx + cy * cy;
+        forup (y, 0, src.rows - 1)
+        {
+            auto* row = falloff.ptr<float>(y);
+            forup (x, 0, src.cols - 1)
+            {
+                float r2 = ((float)x - cx) * ((float)x - cx) + ((float)y - cy) * ((float)y - cy);
+                row[x] = 1 - (float)vignette * r2 / max_r2;
+            }
+        }
+        dst = dst.mul(falloff);
+    }
+    return dst;
+}
+
+/// 传感器噪声：读出噪声（高斯）+ 散粒噪声（方差正比于亮度）
+Mat apply_sensor_noise(const Mat& src, double read_noise, double shot_noise, RNG& rng)
+{
+    if (read_noise <= 0 && shot_noise <= 0) return src;
+
+    Mat sigma;
+    sqrt(max(src, 0) * shot_noise + read_noise * read_noise, sigma);
+
+    Mat noise(src.size(), CV_32F);
+    rng.fill(noise, RNG::NORMAL, 0, 1);
+
+    return src + noise.mul(sigma);
+}
+
+/// 在时刻t0拍一帧：卷帘快门逐行读出，每行的曝光窗口跨越屏幕刷新时混叠前后两帧
+/// \param display 已施加光学退化的屏幕帧序列
+/// \param t0 该帧第一行开始曝光的时刻（秒）
+Mat capture_rolling_shutter(const vector<Mat>& display, double t0, const ChannelParams& params)
+{
+    const Mat& first = display.front();
+    Mat dst(first.size(), CV_32F);
+
+    double camera_interval = 1 / params.camera_fps;
+    double display_interval = 1 / params.display_fps;
+    double exposure = max(params.exposure * camera_interval, 1e-6);
+    auto last = (long long)display.size() - 1;
+
+    forup (y, 0, dst.rows - 1)
+    {
+        double start = t0 + params.rolling_shutter * camera_interval * y / dst.rows;
+        auto index = min((long long)floor(start / display_interval), last);
+        double next_switch = (double)(index + 1) * display_interval;
+        // 曝光窗口中落在下一屏幕帧的比例
+        double weight = clamp((start + exposure - next_switch) / exposure, 0.0, 1.0);
+        auto next = min(index + 1, last);
+
+        const auto* a = display[index].ptr<float>(y);
+        const auto* b = display[next].ptr<float>(y);
+        auto* out = dst.ptr<float>(y);
+        forup (x, 0, dst.cols - 1)
+        {
+            out[x] = (float)((1 - weight) * a[x] + weight * b[x]);
+        }
+    }
+    return dst;
+}
+
+/// 和原文件逐字节比较，返回 <一致的字节数, 出错的比特数>
+/// 一致的字节数用来计算有效吞吐量；输出缺失或比原文件短的部分每字节按8个错误比特计
+pair<size_t, size_t> compare_output(const string& origin_file, const string& current_file)
+{
+    vector<uchar> a = file_to_vector(origin_file);
+    vector<uchar> b = filesystem::exists(current_file) ? file_to_vector(current_file) : vector<uchar>();
+    size_t correct = 0, bit_errors = 0;
+    size_t common = min(a.size(), b.size());
+    for (size_t i = 0; i < common; i++)
+    {
+        correct += a[i] == b[i];
+        bit_errors += popcount((unsigned)(uchar)(a[i] ^ b[i]));
+    }
+    bit_errors += (a.size() - common) * 8;
+    return { correct, bit_errors };
+}
+
+/// 在一个强度下跑一遍完整的信道+解码，返回 <有效吞吐量(B/s), 误码率>
+pair<double, double> simulate(const vector<Mat>& source_frames, string& origin_folder, const ChannelParams& params)
+{
+    mt19937 rng(params.seed);
+    RNG noise_rng(params.seed);
+
+    // 1~4：每个屏幕帧的光学退化，透视在整段录像中固定（手机架在支架上）
+    vector<Mat> display;
+    mt19937 warp_rng(params.seed);
+    for (const Mat& frame : source_frames)
+    {
+        Mat gray;
+        frame.convertTo(gray, CV_32F);
+        mt19937 frame_warp_rng = warp_rng;
+        gray = apply_perspective(gray, params.perspective, frame_warp_rng);
+        gray = apply_blur(gray, params.defocus, params.motion_length, params.motion_angle);
+        gray = apply_photometric(gray, params.gamma, params.vignette);
+        display.push_back(gray);
+    }
+
+    // 5~6：按摄像头帧率重采样，每帧带随机相位并按卷帘快门逐行混叠，最后叠加传感器噪声
+    string capture_folder = "sim_frames";
+    filesystem::remove_all(capture_folder);
+    filesystem::create_directory(capture_folder);
+
+    double duration = (double)display.size() / params.display_fps;
+    uniform_real_distribution<double> phase(0, 1 / params.camera_fps);
+    double offset = phase(rng);
+    int captured = 0;
+    for (double t = offset; t < duration; t = offset + captured / params.camera_fps)
+    {
+        Mat frame = capture_rolling_shutter(display, t, params);
+        frame = apply_sensor_noise(frame, params.read_noise, params.shot_noise, noise_rng);
+
+        Mat output;
+        frame.convertTo(output, CV_8U);
+        // 7：JPEG有损压缩
+        string path = (filesystem::path(capture_folder) / std::format("frame_{:05d}.jpg", ++captured)).string();
+        imwrite(path, output, { IMWRITE_JPEG_QUALITY, params.jpeg_quality });
+    }
+
+    // 7：H.264有损压缩后交给解码器
+    string video_path = "sim_video.mp4";
+    filesystem::remove(video_path);
+    ffmpeg::frames_to_video(capture_folder, video_path, params.camera_fps, params.crf);
+
+    string output_folder = "sim_output";
+    QrEncoder decoder = QrEncoder();
+    decoder.decode(video_path, output_folder, origin_folder);
+
+    size_t total_bytes = 0, correct_bytes = 0, bit_errors = 0;
+    for (const auto& entry : filesystem::directory_iterator(origin_folder))
+    {
+        if (!entry.is_regular_file() || entry.path().extension() != ".bin") continue;
+
+        total_bytes += filesystem::file_size(entry.path());
+        auto [correct, errors] = compare_output(entry.path().string(), output_folder + "/" + entry.path().filename().string());
+        correct_bytes += correct;
+        bit_errors += errors;
+    }
+
+    filesystem::remove_all(capture_folder);
+
+    double goodput = (double)correct_bytes / duration;
+    // 误码率按比特算：出错的比特数 / 原文件总比特数
+    double ber = total_bytes ? (double)bit_errors / (double)(total_bytes * 8) : 0;
+    return { goodput, ber };
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        cout << "channel_simulator <编码视频> <原文件目录> <输出csv> [--severity 0,0.5,1] [--camera-fps 30] ..." << endl;
+        return -1;
+    }
+
+    string input_video_path = argv[1];
+    string origin_folder = argv[2];
+    string output_csv = argv[3];
+
+    ChannelParams base;
+    base.perspective = stod(get_option(argc, argv, "--perspective", to_string(base.perspective)));
+    base.defocus = stod(get_option(argc, argv, "--defocus", to_string(base.defocus)));
+    base.motion_length = stod(get_option(argc, argv, "--motion-length", to_string(base.motion_length)));
+    base.motion_angle = stod(get_option(argc, argv, "--motion-angle", to_string(base.motion_angle)));
+    base.gamma = stod(get_option(argc, argv, "--gamma", to_string(base.gamma)));
+    base.vignette = stod(get_option(argc, argv, "--vignette", to_string(base.vignette)));
+    base.read_noise = stod(get_option(argc, argv, "--read-noise", to_string(base.read_noise)));
+    base.shot_noise = stod(get_option(argc, argv, "--shot-noise", to_string(base.shot_noise)));
+    base.rolling_shutter = stod(get_option(argc, argv, "--rolling-shutter", to_string(base.rolling_shutter)));
+    base.exposure = stod(get_option(argc, argv, "--exposure", to_string(base.exposure)));
+    base.display_fps = stod(get_option(argc, argv, "--display-fps", to_string(base.display_fps)));
+    base.camera_fps = stod(get_option(argc, argv, "--camera-fps", to_string(base.camera_fps)));
+    base.jpeg_quality = stoi(get_option(argc, argv, "--jpeg-quality", to_string(base.jpeg_quality)));
+    base.crf = stoi(get_option(argc, argv, "--crf", to_string(base.crf)));
+    base.seed = stoul(get_option(argc, argv, "--seed", to_string(base.seed)));
+    vector<double> severities = split_to_doubles(get_option(argc, argv, "--severity", "0,0.25,0.5,0.75,1"));
+
+    // 编码视频只拆一次，每个强度都从同一组屏幕帧出发
+    string source_folder = "sim_source";
+    filesystem::remove_all(source_folder);
+    filesystem::create_directory(source_folder);
+    ffmpeg::video_to_images(input_video_path, source_folder);
+
+    vector<Mat> source_frames;
+    for (int i = 1; ; i++)
+    {
+        string path = (filesystem::path(source_folder) / std::format("frame_{:05d}.jpg", i)).string();
+        if (!filesystem::exists(path)) break;
+        Mat frame = imread(path, IMREAD_GRAYSCALE);
+        source_frames.push_back(frame);
+    }
+    filesystem::remove_all(source_folder);
+
+    if (source_frames.empty())
+    {
+        cerr << "channel_simulator：视频中没有帧" << endl;
+        return -1;
+    }
+
+    ofstream csv(output_csv);
+    csv << "severity,perspective,defocus,motion_length,gamma,vignette,read_noise,shot_noise,rolling_shutter,exposure,"
+           "display_fps,camera_fps,jpeg_quality,crf,goodput_Bps,ber\n";
+
+    for (double severity : severities)
+    {
+        ChannelParams params = base.scaled(severity);
+        auto [goodput, ber] = simulate(source_frames, origin_folder, params);
+
+        csv << severity << ',' << params.perspective << ',' << params.defocus << ',' << params.motion_length << ','
+            << params.gamma << ',' << params.vignette << ',' << params.read_noise << ',' << params.shot_noise << ','
+            << params.rolling_shutter << ',' << params.exposure << ',' << params.display_fps << ','
+            << params.camera_fps << ',' << params.jpeg_quality << ',' << params.crf << ','
+            << goodput << ',' << ber << '\n';
+        csv.flush();
+
+        cout << fixed << setprecision(4) << "强度" << severity << "：goodput " << goodput << " B/s，BER " << ber << endl;
+    }
+
+    return 0;
+}
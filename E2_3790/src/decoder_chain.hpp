@@ -0,0 +1,452 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/objdetect.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "qrencode.h"
+#include "zbar.h"
+#ifdef HAVE_QUIRC
+#include "quirc.h"
+#endif
+
+#include "metrics.hpp"
+#include "soft_qr.hpp"
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+// define后让zbar按原始字节返回数据（ZBAR_CFG_BINARY，zbar 0.23起支持），二进制传输需要
+#define ZBAR_BINARY
+
+// OpenCV 4.8起有基于ArUco角点检测的QRCodeDetectorAruco
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+#define HAVE_QRCODE_ARUCO
+#endif
+
+using namespace std;
+using namespace cv;
+
+/// 四边形的四个角按位置排成左上、右上、右下、左下（拍摄时不会转90度以上）
+vector<Point2f> order_corners(const vector<Point2f>& points)
+{
+    auto by = [&](auto key)
+    {
+        return *min_element(points.begin(), points.end(), [&](const Point2f& a, const Point2f& b) { return key(a) < key(b); });
+    };
+    return {
+        by([](const Point2f& p) { return p.x + p.y; }),
+        by([](const Point2f& p) { return p.y - p.x; }),
+        by([](const Point2f& p) { return -p.x - p.y; }),
+        by([](const Point2f& p) { return p.x - p.y; }),
+    };
+}
+
+/// 二维码识别后端，输入都是单通道灰度图
+class QrBackend
+{
+public:
+    virtual ~QrBackend() = default;
+
+    /// 只存指针，必须是字符串常量
+    virtual const char* name() const = 0;
+
+    /// \param gray
+    /// \param output_data 识别到的数据追加到这里
+    /// \return 识别成功返回true
+    virtual bool decode(const Mat& gray, vector<uchar>& output_data) = 0;
+};
+
+class ZbarBackend : public QrBackend
+{
+public:
+    ZbarBackend()
+    {
+        scanner.set_config(zbar::ZBAR_NONE, zbar::ZBAR_CFG_ENABLE, 0);
+        scanner.set_config(zbar::ZBAR_QRCODE, zbar::ZBAR_CFG_ENABLE, 1);
+#ifdef ZBAR_BINARY
+        scanner.set_config(zbar::ZBAR_QRCODE, zbar::ZBAR_CFG_BINARY, 1);
+#endif
+    }
+
+    const char* name() const override
+    {
+        return "zbar";
+    }
+
+    bool decode(const Mat& gray, vector<uchar>& output_data) override
+    {
+        Mat continuous = gray.isContinuous() ? gray : gray.clone();
+        zbar::Image zbar_image(continuous.cols, continuous.rows, "Y800", continuous.data, continuous.cols * continuous.rows);
+        if (scanner.scan(zbar_image) <= 0) return false;
+
+        for (auto symbol = zbar_image.symbol_begin(); symbol != zbar_image.symbol_end(); ++symbol)
+        {
+            const string& symbol_data = symbol->get_data();
+            output_data.insert(output_data.end(), symbol_data.begin(), symbol_data.end());
+
+            // 记下第一个符号的四个角和内容，软判决解码沿用这个几何位置；输入不是原图时先把四角换算回图像坐标
+            if (symbol == zbar_image.symbol_begin() && symbol->get_location_size() == 4)
+            {
+                location.clear();
+                forup (i, 0, 3) location.emplace_back((float)symbol->get_location_x(i), (float)symbol->get_location_y(i));
+                if (!input_to_image.empty())
+                {
+                    vector<Point2f> image_location;
+                    perspectiveTransform(location, image_location, input_to_image);
+                    location = image_location;
+                }
+                payload.assign(symbol_data.begin(), symbol_data.end());
+            }
+        }
+        return true;
+    }
+
+    /// 上一次识别成功的符号四角（图像坐标），没有时为空
+    const vector<Point2f>& last_location() const
+    {
+        return location;
+    }
+
+    /// 接下来的输入不是原图（如多帧融合拉正后的画布）时，设置从输入到图像坐标的单应矩阵，空矩阵表示输入就是原图
+    void set_input_transform(const Mat& transform)
+    {
+        input_to_image = transform;
+    }
+
+    /// 上一次识别成功的内容
+    const vector<uchar>& last_payload() const
+    {
+        return payload;
+    }
+
+private:
+    zbar::ImageScanner scanner;
+    vector<Point2f> location;
+    vector<uchar> payload;
+    Mat input_to_image;
+};
+
+/// 软判决解码：沿用zbar上一次识别到的符号位置，按版本把每个模块中心的亮度采出来
+/// 拿不准的模块所在的码字作为擦除交给RS纠错（见soft_qr.hpp），zbar整张放弃的帧还能救回一部分
+/// 录像时屏幕和手机相对不动，相邻帧的符号位置基本一致
+class SoftQrBackend : public QrBackend
+{
+public:
+    explicit SoftQrBackend(const ZbarBackend& reference) : reference(reference) {}
+
+    const char* name() const override
+    {
+        return "soft_qr";
+    }
+
+    bool decode(const Mat& gray, vector<uchar>& output_data) override
+    {
+        const vector<Point2f>& location = reference.last_location();
+        const vector<uchar>& payload = reference.last_payload();
+        if (location.size() != 4 || payload.empty()) return false;
+
+        // 版本由内容长度决定：用编码端同样的参数重新编码上一次的内容得到，长度变化时相邻版本也试一下
+        if (payload.size() != cached_payload_size)
+        {
+            QRcode* qrCode = QRcode_encodeData((int)payload.size(), payload.data(), 0, QR_ECLEVEL_H);
+            if (qrCode == nullptr) return false;
+            cached_version = qrCode->version;
+            cached_payload_size = payload.size();
+            QRcode_free(qrCode);
+        }
+
+        vector<Point2f> corners = location;
+        if (!image_to_input.empty()) perspectiveTransform(location, corners, image_to_input);
+        corners = order_corners(corners);
+        for (int version : { cached_version, cached_version - 1, cached_version + 1 })
+        {
+            if (version < 1 || version > 40) continue;
+            soft_qr::SampledSymbol symbol = soft_qr::classify_modules(version, sample_modules(gray, corners, version));
+            if (soft_qr::decode_symbol(symbol, output_data)) return true;
+        }
+        return false;
+    }
+
+    /// 接下来的输入不是原图时，设置从图像坐标到输入的单应矩阵，zbar记下的四角按它换算后再采样
+    void set_input_transform(const Mat& transform)
+    {
+        image_to_input = transform;
+    }
+
+private:
+    /// 用四角求单应矩阵，在每个模块中心附近取平均亮度
+    static vector<float> sample_modules(const Mat& gray, const vector<Point2f>& corners, int version)
+    {
+        int size = soft_qr::symbol_size(version);
+        vector<Point2f> module_corners = { { 0, 0 }, { (float)size, 0 }, { (float)size, (float)size }, { 0, (float)size } };
+        Mat homography = getPerspectiveTransform(module_corners, corners);
+
+        vector<Point2f> centers;
+        centers.reserve(size * size);
+        forup (y, 0, size - 1)
+            forup (x, 0, size - 1) centers.emplace_back(x + 0.5f, y + 0.5f);
+        vector<Point2f> image_points;
+        perspectiveTransform(centers, image_points, homography);
+
+        // 采样窗口取模块边长的1/4左右，避开模块边缘的过渡区
+        int radius = max(0, (int)(norm(corners[1] - corners[0]) / size / 4));
+        vector<float> intensity(size * size);
+        forup (i, 0, size * size - 1)
+        {
+            int cx = cvRound(image_points[i].x), cy = cvRound(image_points[i].y);
+            int sum = 0, count = 0;
+            forup (dy, -radius, radius)
+            {
+                forup (dx, -radius, radius)
+                {
+                    int px = cx + dx, py = cy + dy;
+                    if (px < 0 || py < 0 || px >= gray.cols || py >= gray.rows) continue;
+                    sum += gray.at<uchar>(py, px);
+                    count++;
+                }
+            }
+            intensity[i] = count ? (float)sum / count : 128.0f;
+        }
+        return intensity;
+    }
+
+    const ZbarBackend& reference;
+    size_t cached_payload_size = 0;
+    int cached_version = 0;
+    Mat image_to_input;
+};
+
+/// OpenCV自带的识别器，定位比zbar稳，但慢得多；二进制内容可能被按文本处理，base64传输时没有问题
+class OpenCvBackend : public QrBackend
+{
+public:
+    const char* name() const override
+    {
+        return "opencv";
+    }
+
+    bool decode(const Mat& gray, vector<uchar>& output_data) override
+    {
+        string res = detector.detectAndDecode(gray);
+        if (res.empty()) return false;
+        output_data.insert(output_data.end(), res.begin(), res.end());
+        return true;
+    }
+
+private:
+    QRCodeDetector detector;
+};
+
+#ifdef HAVE_QRCODE_ARUCO
+class OpenCvArucoBackend : public QrBackend
+{
+public:
+    const char* name() const override
+    {
+        return "opencv_aruco";
+    }
+
+    bool decode(const Mat& gray, vector<uchar>& output_data) override
+    {
+        string res = detector.detectAndDecode(gray);
+        if (res.empty()) return false;
+        output_data.insert(output_data.end(), res.begin(), res.end());
+        return true;
+    }
+
+private:
+    QRCodeDetectorAruco detector;
+};
+#endif
+
+#ifdef HAVE_QUIRC
+class QuircBackend : public QrBackend
+{
+public:
+    QuircBackend() : decoder(quirc_new()) {}
+
+    ~QuircBackend() override
+    {
+        quirc_destroy(decoder);
+    }
+
+    const char* name() const override
+    {
+        return "quirc";
+    }
+
+    bool decode(const Mat& gray, vector<uchar>& output_data) override
+    {
+        if (decoder == nullptr || quirc_resize(decoder, gray.cols, gray.rows) < 0) return false;
+
+        int width = 0, height = 0;
+        uint8_t* buffer = quirc_begin(decoder, &width, &height);
+        forup (y, 0, height - 1) memcpy(buffer + (size_t)y * width, gray.ptr<uchar>(y), width);
+        quirc_end(decoder);
+
+        forup (i, 0, quirc_count(decoder) - 1)
+        {
+            quirc_code code;
+            quirc_data data;
+            quirc_extract(decoder, i, &code);
+            if (quirc_decode(&code, &data) != QUIRC_SUCCESS) continue;
+
+            output_data.insert(output_data.end(), data.payload, data.payload + data.payload_len);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    quirc* decoder;
+};
+#endif
+
+/// 识别链：第一个后端是主力，其余只在前面都失败时尝试
+/// 统计每个后端的命中率和耗时，备用后端试了足够多次仍从未成功过就移出链
+class DecoderChain
+{
+public:
+    // 备用后端至少试这么多次才考虑移除
+    static constexpr uint64_t PRUNE_AFTER = 200;
+
+    struct BackendStats
+    {
+        uint64_t attempts = 0;
+        uint64_t hits = 0;
+        uint64_t total_ns = 0;
+        bool enabled = true;
+    };
+
+    /// 构造默认的链：zbar → 软判决 → OpenCV → OpenCV ArUco → quirc（后两个视编译条件）
+    DecoderChain()
+    {
+        auto zbar_backend = make_unique<ZbarBackend>();
+        primary = zbar_backend.get();
+        add(std::move(zbar_backend));
+        auto soft_backend = make_unique<SoftQrBackend>(*primary);
+        soft = soft_backend.get();
+        add(std::move(soft_backend));
+        add(make_unique<OpenCvBackend>());
+#ifdef HAVE_QRCODE_ARUCO
+        add(make_unique<OpenCvArucoBackend>());
+#endif
+#ifdef HAVE_QUIRC
+        add(make_unique<QuircBackend>());
+#endif
+    }
+
+    void add(unique_ptr<QrBackend> backend)
+    {
+        backends.push_back(std::move(backend));
+        stats.emplace_back();
+    }
+
+    /// 只用主力后端
+    bool decode_primary(const Mat& gray, vector<uchar>& output_data)
+    {
+        return !backends.empty() && attempt(0, gray, output_data);
+    }
+
+    /// 依次尝试备用后端
+    bool decode_fallback(const Mat& gray, vector<uchar>& output_data)
+    {
+        for (size_t i = 1; i < backends.size(); i++)
+        {
+            if (!stats[i].enabled) continue;
+            if (attempt(i, gray, output_data)) return true;
+
+            if (stats[i].hits == 0 && stats[i].attempts >= PRUNE_AFTER)
+            {
+                stats[i].enabled = false;
+                metrics::global().add("backends_pruned");
+            }
+        }
+        return false;
+    }
+
+    /// 主力失败后尝试备用
+    bool decode(const Mat& gray, vector<uchar>& output_data)
+    {
+        return decode_primary(gray, output_data) || decode_fallback(gray, output_data);
+    }
+
+    /// 识别一张由原图透视变换得到的图（如多帧融合的画布）
+    /// zbar记下的符号四角换算回原图坐标，软判决也按画布坐标采样，后续的原图帧沿用的几何位置不受影响
+    /// \param canvas
+    /// \param canvas_to_image 从画布到原图的单应矩阵，空矩阵表示画布就是原图
+    /// \param output_data
+    bool decode_transformed(const Mat& canvas, const Mat& canvas_to_image, vector<uchar>& output_data)
+    {
+        if (canvas_to_image.empty()) return decode(canvas, output_data);
+
+        primary->set_input_transform(canvas_to_image);
+        soft->set_input_transform(canvas_to_image.inv());
+        bool res = decode(canvas, output_data);
+        primary->set_input_transform(Mat());
+        soft->set_input_transform(Mat());
+        return res;
+    }
+
+    /// 打印每个后端的命中率和平均耗时
+    void print_report() const
+    {
+        forup (i, 0, (int)backends.size() - 1)
+        {
+            const BackendStats& stat = stats[i];
+            if (stat.attempts == 0) continue;
+            cout << fixed << setprecision(2) << backends[i]->name() << "：尝试" << stat.attempts << "次，命中率"
+                 << 100.0 * stat.hits / stat.attempts << "%，平均耗时" << stat.total_ns / 1e6 / stat.attempts << "ms"
+                 << (stat.enabled ? "" : "（已移出）") << endl;
+        }
+    }
+
+    /// 主力后端上一次识别到的符号四角
+    const vector<Point2f>& last_location() const
+    {
+        return primary->last_location();
+    }
+
+    /// 最近一次识别成功的是不是软判决后端
+    /// 软判决可能把错误纠成另一个合法的码字，没有crc的帧要有别的校验才能收下
+    bool last_hit_soft() const
+    {
+        return last_hit != nullptr && last_hit == soft;
+    }
+
+    const vector<BackendStats>& get_stats() const
+    {
+        return stats;
+    }
+
+private:
+    bool attempt(size_t i, const Mat& gray, vector<uchar>& output_data)
+    {
+        metrics::StageTimer timer(backends[i]->name());
+        auto start = chrono::steady_clock::now();
+        bool res = backends[i]->decode(gray, output_data);
+        stats[i].total_ns += (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        stats[i].attempts++;
+        if (res)
+        {
+            stats[i].hits++;
+            last_hit = backends[i].get();
+            metrics::global().add(string("decoder_hits_") + backends[i]->name());
+        }
+        return res;
+    }
+
+    ZbarBackend* primary = nullptr;
+    SoftQrBackend* soft = nullptr;
+    const QrBackend* last_hit = nullptr;
+    vector<unique_ptr<QrBackend>> backends;
+    vector<BackendStats> stats;
+};
@@ -1,3 +1,5 @@
+#include <filesystem>
+#include <format>
 #include <iostream>
 #include <string>
 
@@ -5,35 +7,58 @@ namespace ffmpeg
 {
     using namespace std;
 
+    /// 文件夹里按pattern命名的图片序列，给ffmpeg的路径加上引号，路径分隔符按系统来
+    string sequence_path(const string& folder, const string& pattern)
+    {
+        return "\"" + (filesystem::path(folder) / pattern).string() + "\"";
+    }
+
     /// 对应文件夹中的图片合并为视频
     /// \param image_folder_path 目标文件夹
     /// \param output_path 视频输出路径（带文件）
     /// \param fps 帧率
     /// \param image_extension 目标图片格式后缀
-    void images_to_video(string& image_folder_path, string& output_path,
+    void images_to_video(const string& image_folder_path, const string& output_path,
                          int duration, int fps = 10,
                          const string& image_extension = string("jpg"))
     {
         string cmd =
-            std::format("ffmpeg -loglevel error -framerate {0} -i {1}\\qrCode_%d.{2} -c:v libx264 -t {3} -r {4} -pix_fmt yuv420p {5}",
-                       fps, image_folder_path, image_extension, duration, fps, output_path);
+            std::format("ffmpeg -loglevel error -framerate {0} -i {1} -c:v libx264 -t {2} -r {3} -pix_fmt yuv420p \"{4}\"",
+                       fps, sequence_path(image_folder_path, "qrCode_%d." + image_extension), duration, fps, output_path);
 
 //        cout<<cmd<<endl;
 
         system(cmd.data());
     }
 
+    /// 把frame_%05d序列重新压成H.264视频（用于模拟手机录像的有损压缩）
+    /// \param image_folder_path 目标文件夹
+    /// \param output_path 视频输出路径（带文件）
+    /// \param fps 帧率
+    /// \param crf x264的质量参数，越大压缩越狠
+    /// \param image_extension 目标图片格式后缀
+    void frames_to_video(const string& image_folder_path, const string& output_path,
+                         double fps, int crf = 23,
+                         const string& image_extension = string("jpg"))
+    {
+        string cmd =
+            std::format("ffmpeg -loglevel error -y -framerate {0} -i {1} -c:v libx264 -crf {2} -pix_fmt yuv420p \"{3}\"",
+                       fps, sequence_path(image_folder_path, "frame_%05d." + image_extension), crf, output_path);
+
+        system(cmd.data());
+    }
+
     /// 对应视频分解为图像
     /// \param video_folder_path 目标视频路径
     /// \param output_path 输出文件夹
     /// \param fps 帧率
     /// \param image_extension 输出图片格式后缀
-    void video_to_images(string& video_folder_path, string& output_path,
+    void video_to_images(const string& video_folder_path, const string& output_path,
                          const string& image_extension = string("jpg"))
     {
         string cmd =
-            std::format("ffmpeg -loglevel error -i {0} {1}\\frame_%05d.{2}",
-                       video_folder_path, output_path, image_extension);
+            std::format("ffmpeg -loglevel error -i \"{0}\" {1}",
+                       video_folder_path, sequence_path(output_path, "frame_%05d." + image_extension));
 
 //        cout<<cmd<<endl;
 
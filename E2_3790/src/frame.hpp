@@ -0,0 +1,330 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "byte_io.hpp"
+
+using namespace std;
+
+#include "crc32.hpp"
+
+/// 帧起始字节，同时用来区分帧格式版本
+/// 第一个字节如果是1，转成char后就是负数，所以取0x7E（'~'）/0x7D（'}'），它们也不在base64字符表里，方便识别
+constexpr uint8_t FRAME_BEGIN_V1 = 0x7E;
+constexpr uint8_t FRAME_BEGIN_V2 = 0x7D;
+/// 最初的帧格式，只用于解码旧录像
+constexpr uint8_t FRAME_BEGIN_LEGACY = 0x7F;
+
+/// v2帧头flags的各位
+constexpr uint8_t FRAME_FLAG_START = 1 << 0;
+constexpr uint8_t FRAME_FLAG_END = 1 << 1;
+constexpr uint8_t FRAME_FLAG_CRC = 1 << 2;
+// 第4、5位存帧类型
+constexpr int FRAME_TYPE_SHIFT = 4;
+
+/// 帧类型
+enum FrameType : uint8_t
+{
+    FRAME_DATA = 0,
+    FRAME_MANIFEST = 1,
+    // 分块哈希表，随清单一起发送
+    FRAME_HASHES = 2,
+};
+
+/// 二维码储存的数据（文件的一个分块）
+struct QrData
+{
+    // index(8) + len(4) + start(1) + end(1)
+    static constexpr size_t HEADER_SIZE = 14;
+
+    // 分块序号，从0开始，文件内偏移为 index * 分块大小
+    uint64_t index;
+    vector<uchar> data;
+    uint32_t len;
+    bool start;
+    bool end;
+
+    QrData()
+    {
+        index = 0;
+        len = 0;
+        start = false;
+        end = false;
+    }
+
+    QrData(const vector<uchar>& serializedData) : QrData()
+    {
+        deserialize(serializedData);
+    }
+
+    /// \param serializedData
+    /// \return 数据不足帧头长度或len对不上时返回false
+    bool deserialize(const vector<uchar>& serializedData)
+    {
+        ByteReader reader(serializedData);
+        index = reader.get_u64();
+        len = reader.get_u32();
+        start = reader.get_u8() == '1';
+        end = reader.get_u8() == '1';
+        if (!reader.ok()) return false;
+
+        data = reader.get_bytes(reader.remaining());
+        return data.size() == len;
+    }
+
+    /// 按最初的帧格式解析：index(4，从1开始) + len(4) + start(1) + end(1) + data
+    /// 旧编码器的末尾分块从前一个分块的最后一个字节开始取，这里去掉多出来的这个字节，index也转成从0开始
+    /// \param serializedData
+    /// \return 数据不足帧头长度、len对不上或index为0时返回false
+    bool deserialize_legacy(const vector<uchar>& serializedData)
+    {
+        ByteReader reader(serializedData);
+        uint32_t legacy_index = reader.get_u32();
+        len = reader.get_u32();
+        start = reader.get_u8() == '1';
+        end = reader.get_u8() == '1';
+        if (!reader.ok() || legacy_index == 0) return false;
+
+        data = reader.get_bytes(reader.remaining());
+        if (data.size() != len) return false;
+
+        index = legacy_index - 1;
+        // 旧编码器只给不是末尾分块的第一块标start，只有一块的文件也从第一块开始收
+        if (index == 0) start = true;
+        if (end && !data.empty())
+        {
+            data.erase(data.begin());
+            len = data.size();
+        }
+        return true;
+    }
+
+    vector<uchar> serialize() const
+    {
+        vector<uchar> serializedData;
+        ByteWriter writer(serializedData);
+
+        writer.put_u64(index);
+        writer.put_u32(len);
+        writer.put_u8(start ? '1' : '0');
+        writer.put_u8(end ? '1' : '0');
+        writer.put_bytes(data);
+
+        return serializedData;
+    }
+};
+
+/// 帧格式
+/// 旧格式：begin(1) + destination(1) + source(1) + length(2) + data(旧的QrData) + crc(4，只覆盖data)
+/// v1：begin(1) + type(1) + destination(1) + source(4) + length(4) + data(QrData) + crc(4)
+/// v2：begin(1) + flags(1) + source(varint) + [index(varint)，仅数据帧] + data + [crc(4)，flags带CRC时，覆盖前面的帧头和data]
+///     分块的index/start/end直接放在帧头里，长度由二维码里的总字节数隐含
+struct DataFrame
+{
+    // v1的帧头和crc长度
+    static constexpr size_t OVERHEAD = 15;
+    // 最短的合法帧（v2：begin + flags + 1字节source）
+    static constexpr size_t MIN_SIZE = 3;
+
+    uint8_t begin{};
+    uint8_t type{};
+    uint8_t destination{};
+    // 文件ID，清单帧为0
+    uint32_t source{};
+    uint32_t length{};
+    vector<uchar> data;
+    uint32_t crc{};
+    // 以下仅v2使用
+    uint8_t flags{};
+    uint64_t index{};
+
+    DataFrame() = default;
+
+    DataFrame(const vector<uchar>& data, uint32_t source, uint8_t destination, uint8_t type = FRAME_DATA)
+    {
+        this->data = data;
+
+        this->type = type;
+        this->source = source;
+        this->destination = destination;
+        this->length = this->data.size();
+        this->begin = FRAME_BEGIN_V1;
+    }
+
+    DataFrame(const vector<uchar>& serializedData)
+    {
+        deserialize(serializedData);
+    }
+
+    /// 构造v2紧凑帧
+    /// \param type 帧类型
+    /// \param source 文件ID
+    /// \param chunk 数据帧的分块，清单帧只用其中的data
+    /// \param with_crc 是否带crc（二进制传输时可以省略，靠二维码自身的纠错）
+    static DataFrame compact(uint8_t type, uint32_t source, const QrData& chunk, bool with_crc)
+    {
+        DataFrame frame = DataFrame();
+        frame.begin = FRAME_BEGIN_V2;
+        frame.type = type;
+        frame.source = source;
+        frame.index = chunk.index;
+        frame.data = chunk.data;
+        frame.length = frame.data.size();
+        frame.flags = (uint8_t)(type << FRAME_TYPE_SHIFT);
+        if (type == FRAME_DATA && chunk.start) frame.flags |= FRAME_FLAG_START;
+        if (type == FRAME_DATA && chunk.end) frame.flags |= FRAME_FLAG_END;
+        if (with_crc) frame.flags |= FRAME_FLAG_CRC;
+        return frame;
+    }
+
+    bool has_crc() const
+    {
+        return begin == FRAME_BEGIN_V1 || begin == FRAME_BEGIN_LEGACY || (flags & FRAME_FLAG_CRC);
+    }
+
+    ///
+    /// \param serializedData
+    /// \return 返回1成功，返回-1表示length和data中有一个不对的，返回-2表示不认识的帧头
+    int deserialize(const vector<uchar>& serializedData)
+    {
+        ByteReader reader(serializedData);
+
+        begin = reader.get_u8();
+        if (begin == FRAME_BEGIN_V2) return deserialize_compact(reader);
+        if (begin == FRAME_BEGIN_LEGACY) return deserialize_legacy(reader);
+        if (begin != FRAME_BEGIN_V1) return -2;
+
+        type = reader.get_u8();
+        destination = reader.get_u8();
+        source = reader.get_u32();
+        length = reader.get_u32();
+        if (!reader.ok()) return -2;
+
+        if (reader.remaining() != (size_t)length + 4) return -1;
+        data = reader.get_bytes(length);
+        crc = reader.get_u32();
+
+        return 1;
+    }
+
+    vector<uchar> serialize() const
+    {
+        vector<uchar> serializedData;
+        ByteWriter writer(serializedData);
+
+        if (begin == FRAME_BEGIN_V2)
+        {
+            write_compact_body(writer);
+            if (has_crc()) writer.put_u32(crc);
+            return serializedData;
+        }
+        if (begin == FRAME_BEGIN_LEGACY)
+        {
+            writer.put_u8(begin);
+            writer.put_u8(destination);
+            writer.put_u8((uint8_t)source);
+            writer.put_u16((uint16_t)length);
+            writer.put_bytes(data);
+            writer.put_u32(crc);
+            return serializedData;
+        }
+
+        writer.put_u8(begin);
+        writer.put_u8(type);
+        writer.put_u8(destination);
+        writer.put_u32(source);
+        writer.put_u32(length);
+        writer.put_bytes(data);
+        writer.put_u32(crc);
+
+        return serializedData;
+    }
+
+    uint32_t generate_crc32()
+    {
+        CRC32 generator = CRC32();
+        crc = generator.generate(crc_input());
+        return crc;
+    }
+
+    bool verify_crc32()
+    {
+        if (!has_crc()) return true;
+        CRC32 verifier = CRC32();
+        return verifier.verify(crc_input(), crc);
+    }
+
+    /// 取出数据帧里的分块：v1和旧格式在data里再套一层QrData，v2直接在帧头里
+    /// \param chunk
+    /// \return 格式有误返回false
+    bool to_chunk(QrData& chunk) const
+    {
+        if (begin == FRAME_BEGIN_V1) return chunk.deserialize(data);
+        if (begin == FRAME_BEGIN_LEGACY) return chunk.deserialize_legacy(data);
+
+        chunk.index = index;
+        chunk.data = data;
+        chunk.len = data.size();
+        chunk.start = flags & FRAME_FLAG_START;
+        chunk.end = flags & FRAME_FLAG_END;
+        return true;
+    }
+
+private:
+    /// v2帧crc前面的部分：帧头 + data
+    void write_compact_body(ByteWriter& writer) const
+    {
+        writer.put_u8(begin);
+        writer.put_u8(flags);
+        writer.put_varint(source);
+        if (type == FRAME_DATA) writer.put_varint(index);
+        writer.put_bytes(data);
+    }
+
+    /// crc覆盖的字节：v1的文件内信息都在data里的QrData中，只算data；
+    /// v2的文件ID、index和start/end标志在帧头里，帧头也要算进去，帧头传错时不会把数据写到别的文件或偏移
+    vector<uchar> crc_input() const
+    {
+        if (begin != FRAME_BEGIN_V2) return data;
+
+        vector<uchar> res;
+        ByteWriter writer(res);
+        write_compact_body(writer);
+        return res;
+    }
+
+    /// 旧格式只有数据帧，source是1字节的文件ID
+    int deserialize_legacy(ByteReader& reader)
+    {
+        type = FRAME_DATA;
+        destination = reader.get_u8();
+        source = reader.get_u8();
+        length = reader.get_u16();
+        if (!reader.ok()) return -2;
+
+        if (reader.remaining() != (size_t)length + 4) return -1;
+        data = reader.get_bytes(length);
+        crc = reader.get_u32();
+
+        return 1;
+    }
+
+    int deserialize_compact(ByteReader& reader)
+    {
+        flags = reader.get_u8();
+        type = (flags >> FRAME_TYPE_SHIFT) & 0x3;
+        uint64_t id = reader.get_varint();
+        if (type == FRAME_DATA) index = reader.get_varint();
+        if (!reader.ok() || id > UINT32_MAX) return -2;
+        source = (uint32_t)id;
+
+        size_t crc_size = has_crc() ? 4 : 0;
+        if (reader.remaining() < crc_size) return -1;
+        data = reader.get_bytes(reader.remaining() - crc_size);
+        length = data.size();
+        if (crc_size) crc = reader.get_u32();
+
+        return 1;
+    }
+};
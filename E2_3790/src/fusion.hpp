@@ -0,0 +1,143 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <deque>
+#include <vector>
+
+#include "decoder_chain.hpp"
+#include "metrics.hpp"
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+using namespace std;
+using namespace cv;
+
+/// 多帧融合方式
+enum class FusionMode
+{
+    OFF,
+    // 逐像素平均，抑制高斯噪声
+    MEAN,
+    // 逐像素中值，还能去掉反光、摩尔纹之类的离群值
+    MEDIAN,
+};
+
+/// 多帧融合：同一张二维码在相机里会连续出现3~6帧，单帧都识别不出来时把它们对齐后叠加成一张降噪的图
+/// 对齐分两步：先用上一次识别到的符号四角把区域拉正到固定大小，再用相位相关补偿手抖带来的平移
+class FrameFusion
+{
+public:
+    // 一组最多保留的帧数
+    static constexpr int MAX_FRAMES = 6;
+    // 拉正后的边长
+    static constexpr int CANVAS_SIZE = 600;
+    // 拉正后和组里第一帧的平均差超过它，就认为换了一张二维码
+    static constexpr double CHANGE_THRESHOLD = 20;
+
+    explicit FrameFusion(FusionMode mode = FusionMode::MEDIAN) : mode(mode) {}
+
+    /// 设置符号所在区域（图像坐标，任意顺序的四个角），区域变了会清空当前组
+    void set_roi(const vector<Point2f>& corners)
+    {
+        if (corners.size() != 4 || corners == roi) return;
+        roi = corners;
+        reset();
+
+        // 四周留出1/8的空白区，zbar找定位图形需要静区
+        Point2f center = (corners[0] + corners[1] + corners[2] + corners[3]) / 4;
+        vector<Point2f> source;
+        for (const Point2f& corner : corners) source.push_back(center + (corner - center) * 1.25f);
+        vector<Point2f> target = order_corners(source);
+        homography = getPerspectiveTransform(target, vector<Point2f>{
+            { 0, 0 }, { CANVAS_SIZE, 0 }, { CANVAS_SIZE, CANVAS_SIZE }, { 0, CANVAS_SIZE } });
+    }
+
+    /// 加入一帧识别失败的灰度图
+    /// \return 当前组里的帧数
+    int add(const Mat& gray)
+    {
+        if (mode == FusionMode::OFF) return 0;
+        metrics::StageTimer timer("fusion_align");
+
+        Mat canvas;
+        if (homography.empty()) canvas = gray;
+        else warpPerspective(gray, canvas, homography, Size(CANVAS_SIZE, CANVAS_SIZE), INTER_LINEAR, BORDER_REPLICATE);
+
+        Mat canvas_float;
+        canvas.convertTo(canvas_float, CV_32F);
+        if (!frames.empty())
+        {
+            if (canvas_float.size() != frames.front().size()) reset();
+            else
+            {
+                // 平移补偿
+                Point2d shift = phaseCorrelate(frames.front(), canvas_float, window);
+                Mat translation = (Mat_<double>(2, 3) << 1, 0, -shift.x, 0, 1, -shift.y);
+                warpAffine(canvas_float, canvas_float, translation, canvas_float.size(), INTER_LINEAR, BORDER_REPLICATE);
+
+                if (mean(abs(canvas_float - frames.front()))[0] > CHANGE_THRESHOLD) reset();
+            }
+        }
+        if (frames.empty() && window.size() != canvas_float.size()) createHanningWindow(window, canvas_float.size(), CV_32F);
+
+        frames.push_back(canvas_float);
+        if ((int)frames.size() > MAX_FRAMES) frames.pop_front();
+        return (int)frames.size();
+    }
+
+    /// 把当前组叠加成一张图
+    Mat fuse() const
+    {
+        metrics::StageTimer timer("fusion_stack");
+        Mat res;
+        if (frames.empty()) return res;
+
+        Mat stacked;
+        if (mode == FusionMode::MEAN || frames.size() <= 2)
+        {
+            stacked = Mat::zeros(frames.front().size(), CV_32F);
+            for (const Mat& frame : frames) accumulate(frame, stacked);
+            stacked /= (double)frames.size();
+        }
+        else
+        {
+            // 用逐元素min/max组成的排序网络求中值，每一步都是整图的向量化运算
+            vector<Mat> sorted(frames.begin(), frames.end());
+            forup (i, 0, (int)sorted.size() - 1)
+            {
+                forup (j, 0, (int)sorted.size() - 2 - i)
+                {
+                    Mat low = cv::min(sorted[j], sorted[j + 1]);
+                    Mat high = cv::max(sorted[j], sorted[j + 1]);
+                    sorted[j] = low;
+                    sorted[j + 1] = high;
+                }
+            }
+            size_t middle = sorted.size() / 2;
+            if (sorted.size() % 2) stacked = sorted[middle];
+            else stacked = (sorted[middle - 1] + sorted[middle]) / 2;
+        }
+        stacked.convertTo(res, CV_8U);
+        return res;
+    }
+
+    /// 从拉正后的画布到原图的单应矩阵（组里的帧都已对齐到第一帧），还没有区域时为空
+    Mat canvas_to_image() const
+    {
+        return homography.empty() ? Mat() : homography.inv();
+    }
+
+    /// 识别成功或换了一张二维码后清空
+    void reset()
+    {
+        frames.clear();
+    }
+
+private:
+    FusionMode mode;
+    vector<Point2f> roi;
+    Mat homography;
+    Mat window;
+    deque<Mat> frames;
+};
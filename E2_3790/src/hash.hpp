@@ -0,0 +1,140 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+/// 分块校验用的快速哈希和Merkle树
+/// 用的是XXH64（按xxHash规范自己实现，结果和官方库一致），每字节不到一个时钟周期，比crc32快得多
+namespace hash64
+{
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64_t rotl(uint64_t x, int r)
+    {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    // 按小端读取（x86/ARM都是小端）
+    inline uint64_t read64(const uint8_t* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        return v;
+    }
+
+    inline uint32_t read32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    inline uint64_t round(uint64_t acc, uint64_t input)
+    {
+        acc += input * PRIME64_2;
+        acc = rotl(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    inline uint64_t merge_round(uint64_t acc, uint64_t value)
+    {
+        acc ^= round(0, value);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+
+    uint64_t xxh64(const uint8_t* data, size_t len, uint64_t seed = 0)
+    {
+        const uint8_t* p = data;
+        const uint8_t* end = data + len;
+        uint64_t h;
+
+        if (len >= 32)
+        {
+            uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+            uint64_t v2 = seed + PRIME64_2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME64_1;
+            // 4路并行累加，每次吃32字节
+            for (; p + 32 <= end; p += 32)
+            {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+            }
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge_round(h, v1);
+            h = merge_round(h, v2);
+            h = merge_round(h, v3);
+            h = merge_round(h, v4);
+        }
+        else
+        {
+            h = seed + PRIME64_5;
+        }
+
+        h += len;
+        for (; p + 8 <= end; p += 8)
+        {
+            h ^= round(0, read64(p));
+            h = rotl(h, 27) * PRIME64_1 + PRIME64_4;
+        }
+        if (p + 4 <= end)
+        {
+            h ^= (uint64_t)read32(p) * PRIME64_1;
+            h = rotl(h, 23) * PRIME64_2 + PRIME64_3;
+            p += 4;
+        }
+        for (; p < end; p++)
+        {
+            h ^= *p * PRIME64_5;
+            h = rotl(h, 11) * PRIME64_1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME64_2;
+        h ^= h >> 29;
+        h *= PRIME64_3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    uint64_t xxh64(const vector<uint8_t>& data, uint64_t seed = 0)
+    {
+        return xxh64(data.data(), data.size(), seed);
+    }
+
+    /// Merkle树的根：叶子是各分块的哈希，父节点是两个子节点（小端8字节拼接）的哈希，落单的节点直接升上去
+    /// \param leaves
+    /// \return
+    uint64_t merkle_root(vector<uint64_t> leaves)
+    {
+        if (leaves.empty()) return xxh64(nullptr, 0);
+
+        while (leaves.size() > 1)
+        {
+            size_t parents = (leaves.size() + 1) / 2;
+            for (size_t i = 0; i < parents; i++)
+            {
+                if (2 * i + 1 == leaves.size())
+                {
+                    leaves[i] = leaves[2 * i];
+                    continue;
+                }
+                uint8_t pair[16];
+                memcpy(pair, &leaves[2 * i], 8);
+                memcpy(pair + 8, &leaves[2 * i + 1], 8);
+                leaves[i] = xxh64(pair, 16);
+            }
+            leaves.resize(parents);
+        }
+        return leaves[0];
+    }
+}
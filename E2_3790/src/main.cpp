@@ -15,12 +15,37 @@ map<string, function<bool(int argc, char** argv)>> input_func =
 };
 
 // argv[0]默认是exe文件的路径
+// 通用选项：--metrics <json路径> 退出时输出各阶段计数和耗时；--metrics-interval <毫秒> 定时追加采样到<json路径>.samples
+//          --trace <json路径> 记录各阶段的时间线，输出Chrome trace-event格式（可用Perfetto打开）
 int main(int argc, char** argv)
 {
     string command = argv[1];
     if (input_func.find(command) != input_func.end())
     {
-        if (!input_func[command](argc, argv))
+        string metrics_path = get_option(argc, argv, "--metrics");
+        int metrics_interval = stoi(get_option(argc, argv, "--metrics-interval", "0"));
+        if (!metrics_path.empty() && metrics_interval > 0)
+        {
+            metrics::global().start_sampling(metrics_path + ".samples", chrono::milliseconds(metrics_interval));
+        }
+
+        string trace_path = get_option(argc, argv, "--trace");
+        trace::enabled() = !trace_path.empty();
+
+        bool res = input_func[command](argc, argv);
+
+        if (!trace_path.empty())
+        {
+            trace::registry().write_chrome_trace(trace_path);
+        }
+
+        if (!metrics_path.empty())
+        {
+            metrics::global().stop_sampling();
+            metrics::global().dump(metrics_path);
+        }
+
+        if (!res)
         {
             return -1;
         }
@@ -36,7 +61,7 @@ int main(int argc, char** argv)
 bool encode_input(int argc, char** argv)
 {
     system("chcp 65001");
-    // 指令格式：encode ./ <最大传输单元> <输出文件路径> <生成视频时长>
+    // 指令格式：encode ./ <最大传输单元> <输出文件路径> <生成视频时长> [--frame-version 1|2] [--binary] [--schedule 策略] [--tags 标注] [--verify off|sampled|full] [--carousel] [--repair NACK来源] [--stripes N]
     // 其中./是当前工作目录
     if (argc < 5) return false;
 
@@ -46,6 +71,43 @@ bool encode_input(int argc, char** argv)
     int video_length = stoi(argv[5]);
 
     QrEncoder encoder = QrEncoder();
+    // 可选：--frame-version 1|2 帧格式；--binary 不做base64直接写二进制
+    encoder.options.frame_version = stoi(get_option(argc, argv, "--frame-version", "2"));
+    encoder.options.binary = has_flag(argc, argv, "--binary");
+    // 可选：--schedule rr|srf|wfq|priority 多文件调度策略；--tags 文件名:优先级[:权重],...
+    string schedule = get_option(argc, argv, "--schedule", "srf");
+    if (!parse_schedule_policy(schedule, encoder.options.schedule))
+    {
+        cout << "未知的调度策略：" << schedule << endl;
+        return false;
+    }
+    encoder.options.tags = parse_file_tags(get_option(argc, argv, "--tags"));
+    // 可选：--verify off|sampled|full 生成二维码后的自检；--verify-every N 抽查间隔
+    string verify = get_option(argc, argv, "--verify", "sampled");
+    if (verify == "off") encoder.options.verify = VerifyPolicy::OFF;
+    else if (verify == "full") encoder.options.verify = VerifyPolicy::FULL;
+    else encoder.options.verify = VerifyPolicy::SAMPLED;
+    encoder.options.verify_every = stoi(get_option(argc, argv, "--verify-every", "16"));
+    // 可选：--carousel 循环发送到视频结束；--manifest-interval N 每N张重发一次清单
+    encoder.options.carousel = has_flag(argc, argv, "--carousel");
+    encoder.options.manifest_interval = max(1, stoi(get_option(argc, argv, "--manifest-interval", "100")));
+    // 可选：--stripes N 数据帧分到N个视频（<输出文件名>_1 ~ _N），每块屏幕放一个，同时播放
+    encoder.options.stripes = max(1, stoi(get_option(argc, argv, "--stripes", "1")));
+    // 可选：--repair <NACK文件|tcp:端口> 修复模式，只编码解码端报告缺失的分块（tcp:端口时在本机等解码端连上来）
+    string repair = get_option(argc, argv, "--repair");
+    if (!repair.empty())
+    {
+        if (!nack::receive(repair, encoder.options.repair))
+        {
+            cout << "读取NACK失败：" << repair << endl;
+            return false;
+        }
+        if (encoder.options.repair.empty())
+        {
+            cout << "解码端没有缺失的分块，不需要修复" << endl;
+            return true;
+        }
+    }
     if (!encoder.encode(input_file_path, output_file_path, video_length, max_transmission_unit)) return false;
 
     return true;
@@ -54,13 +116,19 @@ bool encode_input(int argc, char** argv)
 bool decode_input(int argc, char** argv)
 {
     system("chcp 65001");
-    // 指令格式：decode <输入文件路径> <输出目录> (<原文件目录>，用于比较解码准确性，如果为空默认为输出目录)
+    // 指令格式：decode <输入文件路径，多个录像用逗号分隔> <输出目录> (<原文件目录>，用于和原文件逐位比较，不给时只做分块哈希校验) [--fusion off|mean|median] [--carousel] [--nack NACK目标] [--resume]
     if (argc < 4) return false;
 
-    string input_file_path = argv[2];
+    // 条带编码时每块屏幕各录一个视频，一起解码
+    vector<string> input_file_paths;
+    stringstream input_list(argv[2]);
+    for (string path; getline(input_list, path, ',');)
+    {
+        if (!path.empty()) input_file_paths.push_back(path);
+    }
     string output_info_directory = argv[3];
     string origin_file_path;
-    if (argc < 5)
+    if (argc < 5 || string(argv[4]).starts_with("--"))
     {
         origin_file_path = "";
     }
@@ -69,7 +137,17 @@ bool decode_input(int argc, char** argv)
         origin_file_path = argv[4];
     }
     QrEncoder encoder = QrEncoder();
-    if (!encoder.decode(input_file_path, output_info_directory, origin_file_path)) return false;
+    // 可选：--fusion off|mean|median 单帧识别失败时的多帧融合方式
+    string fusion = get_option(argc, argv, "--fusion", "median");
+    if (fusion == "off") encoder.options.fusion = FusionMode::OFF;
+    else if (fusion == "mean") encoder.options.fusion = FusionMode::MEAN;
+    else encoder.options.fusion = FusionMode::MEDIAN;
+    // 可选：--carousel 录像来自轮播，从任意位置开始接收
+    encoder.options.carousel = has_flag(argc, argv, "--carousel");
+    // 可选：--nack <文件|tcp:主机:端口> 解码后把缺失的分块区间发回编码端；--resume 接收修复视频，合并到输出目录里已有的结果
+    encoder.options.nack_target = get_option(argc, argv, "--nack");
+    encoder.options.resume = has_flag(argc, argv, "--resume");
+    if (!encoder.decode(input_file_paths, output_info_directory, origin_file_path)) return false;
 
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "byte_io.hpp"
+
+using namespace std;
+
+/// 清单中一个文件的描述
+struct ManifestEntry
+{
+    uint32_t file_id = 0;
+    string name;
+    uint64_t size = 0;
+    uint32_t chunk_size = 0;
+    // 整个文件的crc32
+    uint32_t hash = 0;
+    // 各分块XXH64组成的Merkle树的根
+    uint64_t merkle_root = 0;
+
+    uint64_t chunk_count() const
+    {
+        return chunk_size ? (size + chunk_size - 1) / chunk_size : 0;
+    }
+
+    void serialize(ByteWriter& writer) const
+    {
+        writer.put_u32(file_id);
+        writer.put_u64(size);
+        writer.put_u32(chunk_size);
+        writer.put_u32(hash);
+        writer.put_u64(merkle_root);
+        writer.put_string(name);
+    }
+
+    bool deserialize(ByteReader& reader)
+    {
+        file_id = reader.get_u32();
+        size = reader.get_u64();
+        chunk_size = reader.get_u32();
+        hash = reader.get_u32();
+        merkle_root = reader.get_u64();
+        // 只保留文件名，防止写到输出目录以外
+        name = filesystem::path(reader.get_string()).filename().string();
+        return reader.ok();
+    }
+};
+
+/// 把清单条目分页打包，每页是一个清单帧的载荷：total(4) + count(2) + 若干条目
+/// total是整个清单的文件数，每页都带上，漏收了某一页时接收端也知道还有文件没见过
+/// \param entries
+/// \param max_payload 每页的最大字节数（单个条目超过时独占一页）
+/// \return
+vector<vector<uchar>> pack_manifest(const vector<ManifestEntry>& entries, size_t max_payload)
+{
+    vector<vector<uchar>> pages;
+    vector<uchar> body;
+    uint16_t count = 0;
+
+    auto flush = [&]()
+    {
+        if (count == 0) return;
+        vector<uchar> page;
+        ByteWriter writer(page);
+        writer.put_u32((uint32_t)entries.size());
+        writer.put_u16(count);
+        writer.put_bytes(body);
+        pages.push_back(page);
+        body.clear();
+        count = 0;
+    };
+
+    for (const ManifestEntry& entry : entries)
+    {
+        vector<uchar> item;
+        ByteWriter writer(item);
+        entry.serialize(writer);
+
+        if (count > 0 && (6 + body.size() + item.size() > max_payload || count == UINT16_MAX)) flush();
+        body.insert(body.end(), item.begin(), item.end());
+        count++;
+    }
+    flush();
+
+    return pages;
+}
+
+/// 解析一页清单
+/// \param payload
+/// \param entries 解析出的条目追加到这里
+/// \param total_files 整个清单的文件数
+/// \return 格式有误返回false
+bool unpack_manifest(const vector<uchar>& payload, vector<ManifestEntry>& entries, uint32_t& total_files)
+{
+    ByteReader reader(payload);
+    total_files = reader.get_u32();
+    uint16_t count = reader.get_u16();
+    if (!reader.ok() || count > total_files) return false;
+    forup (i, 1, count)
+    {
+        ManifestEntry entry;
+        if (!entry.deserialize(reader)) return false;
+        entries.push_back(entry);
+    }
+    return reader.ok() && reader.remaining() == 0;
+}
+
+/// 一页分块哈希：哪个文件、从第几块开始、若干个XXH64
+struct BlockHashPage
+{
+    uint32_t file_id = 0;
+    uint64_t first_index = 0;
+    vector<uint64_t> hashes;
+};
+
+/// 把一个文件的分块哈希分页打包：file_id(4) + first_index(8) + count(2) + count * hash(8)
+/// \param file_id
+/// \param hashes
+/// \param max_payload 每页的最大字节数
+/// \param first_index hashes[0]对应的分块序号，修复时只发缺失区间的哈希
+/// \return
+vector<vector<uchar>> pack_block_hashes(uint32_t file_id, const vector<uint64_t>& hashes, size_t max_payload,
+                                       uint64_t first_index = 0)
+{
+    vector<vector<uchar>> pages;
+    size_t per_page = max<size_t>(1, min<size_t>(UINT16_MAX, (max_payload - 14) / 8));
+    for (size_t first = 0; first < hashes.size(); first += per_page)
+    {
+        size_t count = min(per_page, hashes.size() - first);
+        vector<uchar> page;
+        ByteWriter writer(page);
+        writer.put_u32(file_id);
+        writer.put_u64(first_index + first);
+        writer.put_u16((uint16_t)count);
+        for (size_t i = first; i < first + count; i++) writer.put_u64(hashes[i]);
+        pages.push_back(page);
+    }
+    return pages;
+}
+
+/// 解析一页分块哈希
+/// \param payload
+/// \param page
+/// \return 格式有误返回false
+bool unpack_block_hashes(const vector<uchar>& payload, BlockHashPage& page)
+{
+    ByteReader reader(payload);
+    page.file_id = reader.get_u32();
+    page.first_index = reader.get_u64();
+    uint16_t count = reader.get_u16();
+    page.hashes.clear();
+    forup (i, 1, count) page.hashes.push_back(reader.get_u64());
+    return reader.ok() && reader.remaining() == 0;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "trace.hpp"
+
+using namespace std;
+
+namespace metrics
+{
+    /// 以2的幂划分桶的延迟直方图（单位us），第i个桶记录[2^(i-1), 2^i)us
+    class LatencyHistogram
+    {
+    public:
+        static constexpr int BUCKETS = 32;
+
+        void record(chrono::nanoseconds elapsed)
+        {
+            auto us = (uint64_t)chrono::duration_cast<chrono::microseconds>(elapsed).count();
+            int bucket = 0;
+            while (bucket < BUCKETS - 1 && (1ull << bucket) <= us) bucket++;
+
+            buckets[bucket].fetch_add(1, memory_order_relaxed);
+            count.fetch_add(1, memory_order_relaxed);
+            total_ns.fetch_add((uint64_t)elapsed.count(), memory_order_relaxed);
+
+            uint64_t previous = max_ns.load(memory_order_relaxed);
+            while ((uint64_t)elapsed.count() > previous &&
+                   !max_ns.compare_exchange_weak(previous, (uint64_t)elapsed.count(), memory_order_relaxed));
+        }
+
+        /// 由桶估计分位数（取桶的上界）
+        /// \param quantile 0~1
+        /// \return us
+        uint64_t percentile_us(double quantile) const
+        {
+            uint64_t total = count.load(memory_order_relaxed);
+            if (total == 0) return 0;
+
+            auto target = (uint64_t)ceil(quantile * (double)total);
+            uint64_t seen = 0;
+            for (int i = 0; i < BUCKETS; i++)
+            {
+                seen += buckets[i].load(memory_order_relaxed);
+                if (seen >= target) return 1ull << i;
+            }
+            return 1ull << (BUCKETS - 1);
+        }
+
+        string to_json() const
+        {
+            uint64_t n = count.load(memory_order_relaxed);
+            uint64_t total = total_ns.load(memory_order_relaxed);
+
+            stringstream json;
+            json << "{\"count\":" << n
+                 << ",\"total_ms\":" << (double)total / 1e6
+                 << ",\"mean_us\":" << (n ? (double)total / (double)n / 1e3 : 0)
+                 << ",\"max_us\":" << (double)max_ns.load(memory_order_relaxed) / 1e3
+                 << ",\"p50_us\":" << percentile_us(0.5)
+                 << ",\"p99_us\":" << percentile_us(0.99)
+                 << ",\"buckets_us\":{";
+            bool first = true;
+            for (int i = 0; i < BUCKETS; i++)
+            {
+                uint64_t value = buckets[i].load(memory_order_relaxed);
+                if (value == 0) continue;
+                if (!first) json << ',';
+                json << "\"<" << (1ull << i) << "\":" << value;
+                first = false;
+            }
+            json << "}}";
+            return json.str();
+        }
+
+    private:
+        atomic<uint64_t> buckets[BUCKETS]{};
+        atomic<uint64_t> count{0};
+        atomic<uint64_t> total_ns{0};
+        atomic<uint64_t> max_ns{0};
+    };
+
+    /// 编解码流水线的计数器和各阶段耗时，按名字区分，首次使用时创建
+    /// 按名字查找时加锁，map的节点地址不变，热点处可以缓存counter()/histogram()返回的引用
+    class PipelineMetrics
+    {
+    public:
+        PipelineMetrics() : start_time(chrono::steady_clock::now()) {}
+
+        ~PipelineMetrics()
+        {
+            stop_sampling();
+        }
+
+        atomic<uint64_t>& counter(const string& name)
+        {
+            lock_guard<mutex> lock(registry_mutex);
+            return counters[name];
+        }
+
+        LatencyHistogram& histogram(const string& stage)
+        {
+            lock_guard<mutex> lock(registry_mutex);
+            return histograms[stage];
+        }
+
+        void add(const string& name, uint64_t value = 1)
+        {
+            counter(name).fetch_add(value, memory_order_relaxed);
+        }
+
+        void record(const string& stage, chrono::nanoseconds elapsed)
+        {
+            histogram(stage).record(elapsed);
+        }
+
+        string to_json()
+        {
+            lock_guard<mutex> lock(registry_mutex);
+
+            auto elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+            stringstream json;
+            json << "{\"elapsed_s\":" << elapsed << ",\"counters\":{";
+            bool first = true;
+            for (auto& [name, value] : counters)
+            {
+                if (!first) json << ',';
+                json << '"' << name << "\":" << value.load(memory_order_relaxed);
+                first = false;
+            }
+            json << "},\"stages\":{";
+            first = true;
+            for (auto& [name, histogram] : histograms)
+            {
+                if (!first) json << ',';
+                json << '"' << name << "\":" << histogram.to_json();
+                first = false;
+            }
+            json << "}}";
+            return json.str();
+        }
+
+        bool dump(const string& path)
+        {
+            ofstream file(path);
+            if (!file.is_open()) return false;
+            file << to_json() << endl;
+            return true;
+        }
+
+        /// 开一个线程定时把快照追加写到文件（每行一个JSON）
+        /// \param path 输出路径
+        /// \param interval 采样间隔
+        void start_sampling(const string& path, chrono::milliseconds interval)
+        {
+            stop_sampling();
+            sampling = true;
+            sampler = thread([this, path, interval]()
+            {
+                ofstream file(path, ios::app);
+                unique_lock<mutex> lock(sampler_mutex);
+                while (!sampler_cv.wait_for(lock, interval, [this]() { return !sampling; }))
+                {
+                    file << to_json() << endl;
+                }
+            });
+        }
+
+        void stop_sampling()
+        {
+            {
+                lock_guard<mutex> lock(sampler_mutex);
+                sampling = false;
+            }
+            sampler_cv.notify_all();
+            if (sampler.joinable()) sampler.join();
+        }
+
+    private:
+        chrono::steady_clock::time_point start_time;
+
+        mutex registry_mutex;
+        map<string, atomic<uint64_t>> counters;
+        map<string, LatencyHistogram> histograms;
+
+        mutex sampler_mutex;
+        condition_variable sampler_cv;
+        bool sampling = false;
+        thread sampler;
+    };
+
+    /// 进程内共享的指标对象
+    PipelineMetrics& global()
+    {
+        static PipelineMetrics instance;
+        return instance;
+    }
+
+    /// 作用域计时，析构时记入对应阶段；开启追踪时同时记一段trace区间
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(const char* stage, PipelineMetrics& target = global())
+            : stage(stage), target(target), span(stage), start(chrono::steady_clock::now()) {}
+
+        ~StageTimer()
+        {
+            stop();
+        }
+
+        /// 提前结束计时，之后析构不再重复记录
+        void stop()
+        {
+            if (stopped) return;
+            target.record(stage, chrono::steady_clock::now() - start);
+            span.end();
+            stopped = true;
+        }
+
+    private:
+        const char* stage;
+        PipelineMetrics& target;
+        trace::Span span;
+        chrono::steady_clock::time_point start;
+        bool stopped = false;
+    };
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+/// 选择重传：解码端把没收到的分块区间发回编码端，编码端只生成这些分块的修复视频
+/// 回传通道可以是本地TCP（tcp:主机:端口 / 编码端tcp:端口），也可以直接放一个文件
+namespace nack
+{
+    /// 一段连续缺失的分块
+    struct Range
+    {
+        uint32_t file_id = 0;
+        // 原视频的分块大小，修复视频必须用同样的大小，分块序号才对得上
+        uint32_t chunk_size = 0;
+        uint64_t first = 0;
+        uint64_t count = 0;
+    };
+
+    /// 从接收位图里找出连续缺失的区间
+    /// \param file_id
+    /// \param chunk_size
+    /// \param received 长度可以小于total，超出部分算缺失
+    /// \param total 总块数
+    /// \return
+    vector<Range> ranges_from_bitmap(uint32_t file_id, uint32_t chunk_size, const vector<bool>& received, uint64_t total)
+    {
+        vector<Range> res;
+        for (uint64_t i = 0; i < total; i++)
+        {
+            if (i < received.size() && received[i]) continue;
+            if (!res.empty() && res.back().first + res.back().count == i)
+            {
+                res.back().count++;
+            }
+            else
+            {
+                res.push_back({ file_id, chunk_size, i, 1 });
+            }
+        }
+        return res;
+    }
+
+    /// 文本格式，每行一段：file_id chunk_size first count
+    string serialize(const vector<Range>& ranges)
+    {
+        stringstream text;
+        for (const Range& range : ranges)
+        {
+            text << range.file_id << ' ' << range.chunk_size << ' ' << range.first << ' ' << range.count << '\n';
+        }
+        return text.str();
+    }
+
+    vector<Range> deserialize(const string& text)
+    {
+        vector<Range> res;
+        stringstream lines(text);
+        Range range;
+        while (lines >> range.file_id >> range.chunk_size >> range.first >> range.count)
+        {
+            if (range.count) res.push_back(range);
+        }
+        return res;
+    }
+
+    /// 放文件：先写临时文件再改名，读的一方不会读到一半
+    bool write_file(const string& path, const vector<Range>& ranges)
+    {
+        string tmp_path = path + ".tmp";
+        {
+            ofstream file(tmp_path);
+            if (!file.is_open()) return false;
+            file << serialize(ranges);
+        }
+        error_code error;
+        filesystem::rename(tmp_path, path, error);
+        return !error;
+    }
+
+    bool read_file(const string& path, vector<Range>& ranges)
+    {
+        ifstream file(path);
+        if (!file.is_open()) return false;
+        stringstream text;
+        text << file.rdbuf();
+        ranges = deserialize(text.str());
+        return true;
+    }
+
+#ifdef _WIN32
+    using socket_t = SOCKET;
+    const socket_t INVALID_SOCKET_VALUE = INVALID_SOCKET;
+
+    void close_socket(socket_t sock)
+    {
+        closesocket(sock);
+    }
+
+    bool init_sockets()
+    {
+        static bool ok = []()
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+        return ok;
+    }
+#else
+    using socket_t = int;
+    const socket_t INVALID_SOCKET_VALUE = -1;
+
+    void close_socket(socket_t sock)
+    {
+        close(sock);
+    }
+
+    bool init_sockets()
+    {
+        return true;
+    }
+#endif
+
+    /// 解码端：连上编码端，把缺失区间发过去后关闭连接
+    /// \param host
+    /// \param port
+    /// \param ranges
+    /// \return
+    bool send_tcp(const string& host, uint16_t port, const vector<Range>& ranges)
+    {
+        if (!init_sockets()) return false;
+        socket_t sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (sock == INVALID_SOCKET_VALUE) return false;
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1 ||
+            connect(sock, (sockaddr*)&address, sizeof(address)) != 0)
+        {
+            close_socket(sock);
+            return false;
+        }
+
+        string text = serialize(ranges);
+        size_t sent = 0;
+        while (sent < text.size())
+        {
+            int res = send(sock, text.data() + sent, (int)(text.size() - sent), 0);
+            if (res <= 0) break;
+            sent += res;
+        }
+        close_socket(sock);
+        return sent == text.size();
+    }
+
+    /// 编码端：在本机端口上等一个连接，读到对方关闭为止
+    /// \param port
+    /// \param ranges
+    /// \return
+    bool receive_tcp(uint16_t port, vector<Range>& ranges)
+    {
+        if (!init_sockets()) return false;
+        socket_t server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (server == INVALID_SOCKET_VALUE) return false;
+
+        int reuse = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+        // 只监听本机回环，回传通道不对外开放
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::bind(server, (sockaddr*)&address, sizeof(address)) != 0 || listen(server, 1) != 0)
+        {
+            close_socket(server);
+            return false;
+        }
+
+        socket_t client = accept(server, nullptr, nullptr);
+        close_socket(server);
+        if (client == INVALID_SOCKET_VALUE) return false;
+
+        string text;
+        char buffer[4096];
+        int res;
+        while ((res = recv(client, buffer, sizeof(buffer), 0)) > 0) text.append(buffer, res);
+        close_socket(client);
+
+        ranges = deserialize(text);
+        return res == 0;
+    }
+
+    /// 解析命令行给的端口号，必须整个是1~65535的十进制数
+    bool parse_port(const string& text, uint16_t& port)
+    {
+        unsigned value = 0;
+        auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+        if (error != errc() || end != text.data() + text.size() || value < 1 || value > 65535) return false;
+        port = (uint16_t)value;
+        return true;
+    }
+
+    /// 按目标格式发送：tcp:主机:端口 走TCP，否则当作文件路径
+    /// \return 端口不合法或发送失败返回false
+    bool send(const string& target, const vector<Range>& ranges)
+    {
+        if (target.starts_with("tcp:"))
+        {
+            size_t colon = target.rfind(':');
+            uint16_t port;
+            if (colon <= 4 || !parse_port(target.substr(colon + 1), port)) return false;
+            return send_tcp(target.substr(4, colon - 4), port, ranges);
+        }
+        return write_file(target, ranges);
+    }
+
+    /// 按来源格式接收：tcp:端口 在本机监听，否则当作文件路径
+    /// \return 端口不合法或接收失败返回false
+    bool receive(const string& source, vector<Range>& ranges)
+    {
+        if (source.starts_with("tcp:"))
+        {
+            uint16_t port;
+            return parse_port(source.substr(4), port) && receive_tcp(port, ranges);
+        }
+        return read_file(source, ranges);
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "metrics.hpp"
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+using namespace std;
+using namespace cv;
+
+/// 交给zbar之前的预处理步骤
+enum PreprocessStep
+{
+    // 原始灰度图
+    PREPROCESS_RAW,
+    // 局部自适应二值化，对付反光和暗角
+    PREPROCESS_ADAPTIVE_THRESHOLD,
+    // 限制对比度的自适应直方图均衡，对付低对比度
+    PREPROCESS_CLAHE,
+    // 反锐化掩模，对付失焦和运动模糊
+    PREPROCESS_SHARPEN,
+    PREPROCESS_STEP_COUNT,
+};
+
+const char* preprocess_step_name(PreprocessStep step)
+{
+    static const char* names[PREPROCESS_STEP_COUNT] = { "raw", "adaptive_threshold", "clahe", "sharpen" };
+    return names[step];
+}
+
+/// 对灰度图做一步预处理
+/// \param step
+/// \param gray
+/// \return
+Mat apply_preprocess(PreprocessStep step, const Mat& gray)
+{
+    Mat res;
+    switch (step)
+    {
+        case PREPROCESS_ADAPTIVE_THRESHOLD:
+        {
+            // 窗口取短边的1/16左右，至少要盖住几个模块；MEAN_C内部是boxFilter，OpenCV已经做了SIMD
+            int block = max(15, min(gray.cols, gray.rows) / 16) | 1;
+            adaptiveThreshold(gray, res, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY, block, 10);
+            break;
+        }
+        case PREPROCESS_CLAHE:
+        {
+            thread_local Ptr<CLAHE> clahe = createCLAHE(2.0, Size(8, 8));
+            clahe->apply(gray, res);
+            break;
+        }
+        case PREPROCESS_SHARPEN:
+        {
+            Mat blurred;
+            GaussianBlur(gray, blurred, Size(0, 0), 2.0);
+            addWeighted(gray, 1.5, blurred, -0.5, 0, res);
+            break;
+        }
+        default:
+            res = gray;
+            break;
+    }
+    return res;
+}
+
+/// 预处理级联：按顺序尝试，前一步识别失败才做下一步
+/// 记录每一步的成功次数，成功多的步骤提到前面，本次会话后面的帧优先用它
+class PreprocessCascade
+{
+public:
+    PreprocessCascade()
+    {
+        forup (i, 0, PREPROCESS_STEP_COUNT - 1) order[i] = (PreprocessStep)i;
+    }
+
+    /// \param gray 灰度图
+    /// \param try_decode 识别函数，参数是预处理后的图，识别成功返回true
+    /// \return 成功的步骤，全部失败返回PREPROCESS_STEP_COUNT
+    template<class Decoder>
+    PreprocessStep run(const Mat& gray, Decoder&& try_decode)
+    {
+        forup (pos, 0, PREPROCESS_STEP_COUNT - 1)
+        {
+            PreprocessStep step = order[pos];
+            Mat image;
+            {
+                metrics::StageTimer timer("preprocess");
+                image = apply_preprocess(step, gray);
+            }
+            if (!try_decode(image)) continue;
+
+            hits[step]++;
+            metrics::global().add(string("preprocess_hits_") + preprocess_step_name(step));
+            promote(pos);
+            return step;
+        }
+        metrics::global().add("preprocess_misses");
+        return PREPROCESS_STEP_COUNT;
+    }
+
+    const array<PreprocessStep, PREPROCESS_STEP_COUNT>& get_order() const
+    {
+        return order;
+    }
+
+private:
+    /// 成功次数超过前一个步骤时往前挪
+    void promote(int pos)
+    {
+        while (pos > 0 && hits[order[pos]] > hits[order[pos - 1]])
+        {
+            swap(order[pos], order[pos - 1]);
+            pos--;
+        }
+    }
+
+    array<PreprocessStep, PREPROCESS_STEP_COUNT> order{};
+    array<uint64_t, PREPROCESS_STEP_COUNT> hits{};
+};
@@ -0,0 +1,447 @@
+#pragma once
+
+#include <opencv2/opencv.hpp>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame.hpp"
+#include "hash.hpp"
+#include "manifest.hpp"
+#include "nack.hpp"
+
+using namespace std;
+
+/// 把收到的分块按偏移写回文件，记录每个文件收到了哪些分块
+/// 多个录像同时解码时共用一个，公开的接收/查询方法都加了锁
+class Reassembler
+{
+public:
+    struct FileState
+    {
+        uint32_t file_id = 0;
+        string name;
+        uint64_t size = 0;
+        uint32_t chunk_size = 0;
+        uint32_t hash = 0;
+        bool has_manifest = false;
+        // 收到过start分块后才开始接收
+        bool started = false;
+        // 0表示还不知道一共几块（既没有清单也没收到end分块）
+        uint64_t total_chunks = 0;
+        vector<bool> received;
+        uint64_t received_count = 0;
+        // 分块大小未知时先暂存在内存里
+        map<uint64_t, vector<uchar>> pending;
+        // 末尾分块的长度，没有清单时用来算文件大小
+        uint32_t last_len = 0;
+        // 收齐时是第几帧，-1表示没收齐
+        int64_t completed_frame = -1;
+        // 整个文件的crc32是否和清单一致（finish后有效）
+        bool verified = false;
+
+        uint64_t merkle_root = 0;
+        // 收到的分块哈希，hash_known标记哪些已经收到
+        vector<uint64_t> block_hashes;
+        vector<bool> hash_known;
+        uint64_t hashes_known = 0;
+        // 分块和哈希对得上
+        vector<bool> block_verified;
+        // 收到过哈希对不上的分块，还没有收到正确的
+        vector<bool> block_bad;
+        uint64_t hash_failures = 0;
+    };
+
+    /// 没有清单时能接受的最大文件大小；帧头里的分块序号在清单到来之前只按它限制，
+    /// 传错或伪造的序号不会让接收端按它分配巨大的数组
+    static constexpr uint64_t MAX_FILE_SIZE = 256ULL << 20;
+    /// 分块大小还不知道时按这个最小值估算序号上限
+    static constexpr uint64_t MIN_CHUNK_SIZE = 64;
+
+    /// \param output_directory
+    /// \param require_start 收到start分块后才开始接收
+    /// \param resume 接着上一次的结果收：输出目录里已有的文件和.map里收到的分块算作已收到，用于接收修复视频
+    explicit Reassembler(const string& output_directory, bool require_start = true, bool resume = false)
+        : output_directory(output_directory), require_start(require_start), resume(resume) {}
+
+    void on_manifest(const ManifestEntry& entry)
+    {
+        lock_guard<mutex> lock(files_mutex);
+        FileState& state = files[entry.file_id];
+        if (state.has_manifest) return;
+
+        state.file_id = entry.file_id;
+        state.name = entry.name;
+        state.size = entry.size;
+        state.chunk_size = entry.chunk_size;
+        state.hash = entry.hash;
+        state.merkle_root = entry.merkle_root;
+        state.has_manifest = true;
+        state.total_chunks = entry.chunk_count();
+        if (state.received.size() < state.total_chunks) state.received.resize(state.total_chunks);
+        if (state.block_hashes.size() < state.total_chunks) resize_blocks(state, state.total_chunks);
+
+        flush_pending(state);
+        if (resume) load_previous(state);
+    }
+
+    /// 清单页里带的整个清单的文件数，complete()要等这么多个文件都见过清单
+    /// \param total
+    void on_manifest_total(uint32_t total)
+    {
+        lock_guard<mutex> lock(files_mutex);
+        expected_files = max(expected_files, total);
+    }
+
+    /// 收到一页分块哈希，已经收到的分块马上校验
+    /// \param page
+    void on_block_hashes(const BlockHashPage& page)
+    {
+        lock_guard<mutex> lock(files_mutex);
+        FileState& state = files[page.file_id];
+        state.file_id = page.file_id;
+
+        // 序号超出总块数（还不知道时超出上限）的页不要，先比first_index再相加，防止溢出
+        uint64_t limit = state.total_chunks ? state.total_chunks : max_chunks(state);
+        if (page.first_index > limit || page.hashes.size() > limit - page.first_index) return;
+        uint64_t end = page.first_index + page.hashes.size();
+        if (state.block_hashes.size() < end) resize_blocks(state, end);
+
+        for (size_t i = 0; i < page.hashes.size(); i++)
+        {
+            uint64_t index = page.first_index + i;
+            if (state.hash_known[index]) continue;
+            state.block_hashes[index] = page.hashes[i];
+            state.hash_known[index] = true;
+            state.hashes_known++;
+
+            if (index < state.received.size() && state.received[index] && !check_block(state, index, read_block(state, index)))
+            {
+                // 之前收下的分块是坏的，当作没收到，等重传
+                state.received[index] = false;
+                state.received_count--;
+                state.completed_frame = -1;
+            }
+        }
+    }
+
+    /// 收到一个分块
+    /// \param file_id
+    /// \param chunk
+    /// \param frame 当前帧号，用来记录文件收齐的时间
+    /// \return 新收到的返回true，重复、还没开始接收、序号超出范围或哈希对不上的返回false
+    bool on_chunk(uint32_t file_id, const QrData& chunk, int64_t frame)
+    {
+        lock_guard<mutex> lock(files_mutex);
+        FileState& state = files[file_id];
+        state.file_id = file_id;
+        if (!state.total_chunks && chunk.index >= max_chunks(state, chunk.end ? 0 : chunk.len)) return false;
+
+        if (require_start && !state.started)
+        {
+            if (!chunk.start) return false;
+            state.started = true;
+        }
+
+        if (chunk.index < state.received.size() && state.received[chunk.index]) return false;
+        if (state.total_chunks && chunk.index >= state.total_chunks) return false;
+
+        if (chunk.index >= state.block_hashes.size()) resize_blocks(state, chunk.index + 1);
+        if (state.hash_known[chunk.index] && !check_block(state, chunk.index, chunk.data)) return false;
+
+        if (chunk.index >= state.received.size()) state.received.resize(chunk.index + 1);
+        state.received[chunk.index] = true;
+        state.received_count++;
+
+        // 没有清单时从分块本身推断：非末尾分块都是满的，末尾分块给出总块数
+        if (!state.has_manifest)
+        {
+            if (!chunk.end && state.chunk_size == 0) state.chunk_size = chunk.len;
+            if (chunk.end)
+            {
+                state.total_chunks = chunk.index + 1;
+                state.received.resize(state.total_chunks);
+                resize_blocks(state, state.total_chunks);
+                state.last_len = chunk.len;
+            }
+        }
+
+        if (state.chunk_size || chunk.index == 0)
+        {
+            write_chunk(state, chunk.index, chunk.data);
+        }
+        else
+        {
+            state.pending[chunk.index] = chunk.data;
+        }
+        flush_pending(state);
+
+        if (state.completed_frame < 0 && file_complete(state)) state.completed_frame = frame;
+        return true;
+    }
+
+    /// 这个分块的哈希是否已经收到，收到时on_chunk会逐块校验
+    bool block_hash_known(uint32_t file_id, uint64_t index) const
+    {
+        lock_guard<mutex> lock(files_mutex);
+        auto it = files.find(file_id);
+        return it != files.end() && index < it->second.hash_known.size() && it->second.hash_known[index];
+    }
+
+    bool file_complete(const FileState& state) const
+    {
+        return state.total_chunks != 0 && state.received_count == state.total_chunks;
+    }
+
+    /// 清单里的文件全部收齐（没收到清单时不算完成）
+    /// 清单的每一页都带总文件数，漏收了哪一页时见过清单的文件数不够，不会提前结束
+    bool complete() const
+    {
+        lock_guard<mutex> lock(files_mutex);
+        if (expected_files == 0) return false;
+        uint32_t described = 0;
+        for (auto& [file_id, state] : files)
+        {
+            if (!state.has_manifest) return false;
+            if (state.total_chunks && !file_complete(state)) return false;
+            described++;
+        }
+        return described >= expected_files;
+    }
+
+    uint64_t missing_chunks() const
+    {
+        lock_guard<mutex> lock(files_mutex);
+        uint64_t res = 0;
+        for (auto& [file_id, state] : files)
+        {
+            if (state.total_chunks > state.received_count) res += state.total_chunks - state.received_count;
+        }
+        return res;
+    }
+
+    /// 还没收到的分块区间，发回编码端生成修复视频
+    /// 不知道总块数或分块大小的文件没法指明缺哪些，不在其中
+    vector<nack::Range> nack_ranges() const
+    {
+        lock_guard<mutex> lock(files_mutex);
+        vector<nack::Range> res;
+        for (auto& [file_id, state] : files)
+        {
+            if (!state.total_chunks || !state.chunk_size) continue;
+            vector<nack::Range> ranges = nack::ranges_from_bitmap(file_id, state.chunk_size, state.received, state.total_chunks);
+            res.insert(res.end(), ranges.begin(), ranges.end());
+        }
+        return res;
+    }
+
+    /// 分块哈希都收到时，用它们重算Merkle根和清单比较，确认哈希表本身没有被篡改或传错
+    bool merkle_verified(const FileState& state) const
+    {
+        if (!state.has_manifest || state.hashes_known != state.total_chunks) return false;
+        return hash64::merkle_root(state.block_hashes) == state.merkle_root;
+    }
+
+    /// 逐块的校验结果：V已校验、?收到但没有哈希可对、X只收到过坏块、-没收到
+    string block_map(const FileState& state) const
+    {
+        string res(state.total_chunks, '-');
+        for (uint64_t i = 0; i < state.total_chunks; i++)
+        {
+            if (i < state.received.size() && state.received[i]) res[i] = state.block_verified[i] ? 'V' : '?';
+            else if (state.block_bad[i]) res[i] = 'X';
+        }
+        return res;
+    }
+
+    /// 把逐块校验结果写到文件：第一行是统计，第二行是block_map
+    /// \param state
+    /// \param path
+    /// \return
+    bool write_block_map(const FileState& state, const string& path) const
+    {
+        ofstream file(path);
+        if (!file.is_open()) return false;
+
+        string map = block_map(state);
+        file << "verified " << ranges::count(map, 'V') << " unverified " << ranges::count(map, '?')
+             << " bad " << ranges::count(map, 'X') << " missing " << ranges::count(map, '-')
+             << " merkle " << (merkle_verified(state) ? "ok" : "unchecked") << '\n';
+        file << map << endl;
+        return true;
+    }
+
+    /// 接收结束：按清单截断并改成原文件名，校验整个文件的crc32
+    void finish()
+    {
+        lock_guard<mutex> lock(files_mutex);
+        for (auto& [file_id, state] : files)
+        {
+            string part = part_path(state);
+            if (!filesystem::exists(part))
+            {
+                ofstream(part, ios::binary).close();
+            }
+            if (!state.has_manifest && state.total_chunks && (state.chunk_size || state.total_chunks == 1))
+            {
+                state.size = (state.total_chunks - 1) * state.chunk_size + state.last_len;
+            }
+            if (state.has_manifest || state.total_chunks)
+            {
+                filesystem::resize_file(part, state.size);
+            }
+
+            string target = output_path(state);
+            filesystem::remove(target);
+            filesystem::rename(part, target);
+
+            if (state.has_manifest)
+            {
+                ifstream file(target, ios::binary);
+                vector<uchar> content = vector<uchar>(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+                CRC32 crc = CRC32();
+                state.verified = crc.generate(content) == state.hash;
+            }
+        }
+    }
+
+    /// 最终输出的文件路径：有清单用原文件名，否则用"文件ID.bin"
+    string output_path(const FileState& state) const
+    {
+        string name = state.has_manifest && !state.name.empty() ? state.name : std::format("{:d}.bin", state.file_id);
+        return output_directory + "/" + name;
+    }
+
+    const map<uint32_t, FileState>& get_files() const
+    {
+        return files;
+    }
+
+private:
+    /// 还不知道总块数时分块序号的上限，分块大小按已知的（或这个分块自己的）算
+    /// \param state
+    /// \param chunk_len 当前分块的长度，末尾分块不算（可能不满）
+    uint64_t max_chunks(const FileState& state, uint64_t chunk_len = 0) const
+    {
+        uint64_t chunk_size = state.chunk_size ? state.chunk_size : chunk_len;
+        return MAX_FILE_SIZE / max(chunk_size, MIN_CHUNK_SIZE);
+    }
+
+    string part_path(const FileState& state) const
+    {
+        return output_directory + std::format("/{:d}.part", state.file_id);
+    }
+
+    void write_chunk(const FileState& state, uint64_t index, const vector<uchar>& data)
+    {
+        string path = part_path(state);
+        if (!filesystem::exists(path))
+        {
+            ofstream(path, ios::binary).close();
+        }
+
+        fstream file(path, ios::binary | ios::in | ios::out);
+        file.seekp((streamoff)(index * state.chunk_size));
+        file.write(reinterpret_cast<const char*>(data.data()), (streamsize)data.size());
+    }
+
+    void resize_blocks(FileState& state, uint64_t count)
+    {
+        state.block_hashes.resize(count);
+        state.hash_known.resize(count);
+        state.block_verified.resize(count);
+        state.block_bad.resize(count);
+    }
+
+    /// 对比分块和收到的哈希
+    /// \return 对不上返回false，并把这一块标记为坏块
+    bool check_block(FileState& state, uint64_t index, const vector<uchar>& data)
+    {
+        if (hash64::xxh64(data) == state.block_hashes[index])
+        {
+            state.block_verified[index] = true;
+            state.block_bad[index] = false;
+            return true;
+        }
+        state.block_verified[index] = false;
+        state.block_bad[index] = true;
+        state.hash_failures++;
+        return false;
+    }
+
+    /// 读回已经收到的分块（还在内存里的直接取）
+    vector<uchar> read_block(const FileState& state, uint64_t index) const
+    {
+        auto it = state.pending.find(index);
+        if (it != state.pending.end()) return it->second;
+        if (!state.chunk_size) return {};
+
+        uint64_t len = state.chunk_size;
+        if (state.has_manifest) len = min<uint64_t>(len, state.size - index * state.chunk_size);
+        else if (index + 1 == state.total_chunks) len = state.last_len;
+
+        vector<uchar> res(len);
+        ifstream file(part_path(state), ios::binary);
+        file.seekg((streamoff)(index * state.chunk_size));
+        file.read(reinterpret_cast<char*>(res.data()), (streamsize)len);
+        res.resize(file.gcount());
+        return res;
+    }
+
+    /// 从上一次的输出文件里取回已经收到的分块，写进这一次的.part
+    /// 上一次的.map和清单的块数对不上时不取
+    void load_previous(FileState& state)
+    {
+        string previous = output_path(state);
+        string map_path = output_directory + "/" + filesystem::path(previous).stem().string() + ".map";
+        ifstream map_file(map_path);
+        string summary, map;
+        if (!filesystem::exists(previous) || !getline(map_file, summary) || !getline(map_file, map)) return;
+        if (map.size() != state.total_chunks) return;
+
+        ifstream file(previous, ios::binary);
+        vector<uchar> data(state.chunk_size);
+        for (uint64_t i = 0; i < state.total_chunks; i++)
+        {
+            if ((map[i] != 'V' && map[i] != '?') || state.received[i]) continue;
+
+            uint64_t len = min<uint64_t>(state.chunk_size, state.size - i * state.chunk_size);
+            data.resize(len);
+            file.seekg((streamoff)(i * state.chunk_size));
+            if (!file.read(reinterpret_cast<char*>(data.data()), (streamsize)len))
+            {
+                file.clear();
+                continue;
+            }
+
+            write_chunk(state, i, data);
+            state.received[i] = true;
+            state.received_count++;
+            state.block_verified[i] = map[i] == 'V';
+        }
+        state.started = true;
+    }
+
+    void flush_pending(FileState& state)
+    {
+        if (!state.chunk_size) return;
+        for (auto& [index, data] : state.pending)
+        {
+            write_chunk(state, index, data);
+        }
+        state.pending.clear();
+    }
+
+    string output_directory;
+    bool require_start;
+    bool resume;
+    mutable mutex files_mutex;
+    map<uint32_t, FileState> files;
+    // 清单里一共有几个文件，0表示还没收到清单
+    uint32_t expected_files = 0;
+};
@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <queue>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+using namespace std;
+
+/// 帧调度策略：决定下一张二维码发哪个文件的哪个分块
+enum class SchedulePolicy
+{
+    // 每轮给每个没发完的文件各发一块（旧行为）
+    ROUND_ROBIN,
+    // 剩余分块最少的文件先发完，小文件最先收齐
+    SHORTEST_REMAINING_FIRST,
+    // 按权重分配带宽，权重为2的文件得到两倍的帧
+    WEIGHTED_FAIR,
+    // 按用户标注的优先级，高优先级的发完才发低优先级的，同级轮转
+    PRIORITY,
+};
+
+/// \param name rr / srf / wfq / priority
+/// \param policy
+/// \return 不认识的名字返回false
+bool parse_schedule_policy(const string& name, SchedulePolicy& policy)
+{
+    static const map<string, SchedulePolicy> names =
+    {
+        { "rr", SchedulePolicy::ROUND_ROBIN },
+        { "srf", SchedulePolicy::SHORTEST_REMAINING_FIRST },
+        { "wfq", SchedulePolicy::WEIGHTED_FAIR },
+        { "priority", SchedulePolicy::PRIORITY },
+    };
+    auto it = names.find(name);
+    if (it == names.end()) return false;
+    policy = it->second;
+    return true;
+}
+
+/// 用户给单个文件的标注
+struct FileTag
+{
+    int priority = 0;
+    double weight = 1;
+};
+
+/// 解析标注，格式为 文件名:优先级[:权重]，多个文件用逗号隔开，如 "config.bin:9,video.bin:0:0.5"
+/// \param text
+/// \return 文件名到标注的映射，格式不对的项跳过
+map<string, FileTag> parse_file_tags(const string& text)
+{
+    map<string, FileTag> tags;
+    stringstream items(text);
+    string item;
+    while (getline(items, item, ','))
+    {
+        stringstream fields(item);
+        string name, priority, weight;
+        if (!getline(fields, name, ':') || !getline(fields, priority, ':')) continue;
+        getline(fields, weight, ':');
+
+        try
+        {
+            FileTag tag;
+            tag.priority = stoi(priority);
+            if (!weight.empty()) tag.weight = max(stod(weight), 1e-6);
+            tags[name] = tag;
+        }
+        catch (...) {}
+    }
+    return tags;
+}
+
+/// 帧调度器基类，子类只需决定下一个发哪个文件，每个文件内部按分块序号顺序发送
+class FrameScheduler
+{
+public:
+    virtual ~FrameScheduler() = default;
+
+    void add_file(uint32_t file_id, uint64_t chunk_count, const FileTag& tag = FileTag())
+    {
+        if (chunk_count == 0) return;
+        entries.push_back({ file_id, chunk_count, 0, tag.priority, tag.weight });
+        on_add(entries.size() - 1);
+    }
+
+    /// 取下一个要发的分块
+    /// \param file_id
+    /// \param index
+    /// \return 全部发完返回false
+    bool next(uint32_t& file_id, uint64_t& index)
+    {
+        int pos = pick();
+        if (pos < 0) return false;
+
+        Entry& entry = entries[pos];
+        file_id = entry.file_id;
+        index = entry.sent++;
+        on_sent(pos);
+        return true;
+    }
+
+protected:
+    struct Entry
+    {
+        uint32_t file_id;
+        uint64_t total;
+        uint64_t sent;
+        int priority;
+        double weight;
+
+        bool done() const
+        {
+            return sent >= total;
+        }
+    };
+
+    /// \return 下一个要发的文件在entries中的下标，全部发完返回-1
+    virtual int pick() = 0;
+    virtual void on_add(size_t pos) {}
+    virtual void on_sent(size_t pos) {}
+
+    vector<Entry> entries;
+};
+
+class RoundRobinScheduler : public FrameScheduler
+{
+protected:
+    int pick() override
+    {
+        forup (step, 1, (int)entries.size())
+        {
+            size_t pos = cursor++ % entries.size();
+            if (!entries[pos].done()) return (int)pos;
+        }
+        return -1;
+    }
+
+private:
+    size_t cursor = 0;
+};
+
+class ShortestRemainingScheduler : public FrameScheduler
+{
+protected:
+    // 选中的文件剩余量只会变少，所以一直发它直到发完，再重新找最短的
+    int pick() override
+    {
+        if (current >= 0 && !entries[current].done()) return current;
+
+        current = -1;
+        for (size_t pos = 0; pos < entries.size(); pos++)
+        {
+            if (entries[pos].done()) continue;
+            if (current < 0 || remaining(entries[pos]) < remaining(entries[current])) current = (int)pos;
+        }
+        return current;
+    }
+
+private:
+    static uint64_t remaining(const Entry& entry)
+    {
+        return entry.total - entry.sent;
+    }
+
+    int current = -1;
+};
+
+/// 步长调度：每发一块，文件的虚拟时间前进 1/权重，总是发虚拟时间最小的
+class WeightedFairScheduler : public FrameScheduler
+{
+protected:
+    int pick() override
+    {
+        while (!queue.empty() && entries[queue.top().second].done()) queue.pop();
+        return queue.empty() ? -1 : (int)queue.top().second;
+    }
+
+    void on_add(size_t pos) override
+    {
+        passes.push_back(1 / entries[pos].weight);
+        queue.push({ passes[pos], pos });
+    }
+
+    void on_sent(size_t pos) override
+    {
+        queue.pop();
+        passes[pos] += 1 / entries[pos].weight;
+        if (!entries[pos].done()) queue.push({ passes[pos], pos });
+    }
+
+private:
+    vector<double> passes;
+    priority_queue<pair<double, size_t>, vector<pair<double, size_t>>, greater<>> queue;
+};
+
+class PriorityScheduler : public FrameScheduler
+{
+protected:
+    // 只在最高优先级的未完成文件里轮转
+    int pick() override
+    {
+        bool found = false;
+        for (const Entry& entry : entries)
+        {
+            if (!entry.done() && (!found || entry.priority > best_priority))
+            {
+                found = true;
+                best_priority = entry.priority;
+            }
+        }
+        if (!found) return -1;
+
+        forup (step, 1, (int)entries.size())
+        {
+            size_t pos = cursor++ % entries.size();
+            if (!entries[pos].done() && entries[pos].priority == best_priority) return (int)pos;
+        }
+        return -1;
+    }
+
+private:
+    size_t cursor = 0;
+    int best_priority = 0;
+};
+
+unique_ptr<FrameScheduler> make_scheduler(SchedulePolicy policy)
+{
+    switch (policy)
+    {
+        case SchedulePolicy::SHORTEST_REMAINING_FIRST: return make_unique<ShortestRemainingScheduler>();
+        case SchedulePolicy::WEIGHTED_FAIR: return make_unique<WeightedFairScheduler>();
+        case SchedulePolicy::PRIORITY: return make_unique<PriorityScheduler>();
+        default: return make_unique<RoundRobinScheduler>();
+    }
+}
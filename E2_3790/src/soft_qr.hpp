@@ -0,0 +1,720 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define forup(i, l, r) for (int i = l; i <= r; i++)
+#define fdown(i, l, r) for (int i = r; i >= l; i--)
+
+using namespace std;
+
+/// 软判决二维码解码：已知版本和每个模块的采样亮度，置信度低的模块所在的码字当作擦除交给RS纠错
+/// RS码对擦除（已知位置）的纠正能力是未知错误的两倍，ECC-H下每块可擦除的码字数为纠错码字数
+/// 不依赖OpenCV，采样由调用方完成
+namespace soft_qr
+{
+    /// 纠错等级，同时是下面两张表的行号
+    enum ErrorCorrectionLevel
+    {
+        ECL_L = 0,
+        ECL_M = 1,
+        ECL_Q = 2,
+        ECL_H = 3,
+    };
+
+    // 每块的纠错码字数，[纠错等级][版本]
+    const int8_t ECC_CODEWORDS_PER_BLOCK[4][41] =
+    {
+        { -1,  7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+        { -1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28 },
+        { -1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+        { -1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+    };
+
+    // 纠错块数，[纠错等级][版本]
+    const int8_t NUM_ERROR_CORRECTION_BLOCKS[4][41] =
+    {
+        { -1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25 },
+        { -1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49 },
+        { -1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68 },
+        { -1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81 },
+    };
+
+    /// GF(256)，本原多项式 x^8 + x^4 + x^3 + x^2 + 1（0x11D），生成元为2
+    class GaloisField
+    {
+    public:
+        GaloisField()
+        {
+            int x = 1;
+            forup (i, 0, 254)
+            {
+                exp_table[i] = (uint8_t)x;
+                log_table[x] = i;
+                x <<= 1;
+                if (x & 0x100) x ^= 0x11D;
+            }
+            // 乘法时指数相加不用取模
+            forup (i, 255, 511) exp_table[i] = exp_table[i - 255];
+        }
+
+        uint8_t mul(uint8_t a, uint8_t b) const
+        {
+            if (a == 0 || b == 0) return 0;
+            return exp_table[log_table[a] + log_table[b]];
+        }
+
+        uint8_t div(uint8_t a, uint8_t b) const
+        {
+            if (a == 0) return 0;
+            return exp_table[(log_table[a] + 255 - log_table[b]) % 255];
+        }
+
+        /// 2的power次方，power可以为负
+        uint8_t pow2(int power) const
+        {
+            return exp_table[((power % 255) + 255) % 255];
+        }
+
+        uint8_t inverse(uint8_t a) const
+        {
+            return exp_table[255 - log_table[a]];
+        }
+
+    private:
+        uint8_t exp_table[512]{};
+        int log_table[256]{};
+    };
+
+    const GaloisField& gf()
+    {
+        static const GaloisField field;
+        return field;
+    }
+
+    /// 多项式都按高次项在前存放，和码字顺序一致
+    using Poly = vector<uint8_t>;
+
+    uint8_t poly_eval(const Poly& p, uint8_t x)
+    {
+        uint8_t y = p.empty() ? 0 : p[0];
+        for (size_t i = 1; i < p.size(); i++) y = gf().mul(y, x) ^ p[i];
+        return y;
+    }
+
+    Poly poly_add(const Poly& p, const Poly& q)
+    {
+        Poly r(max(p.size(), q.size()), 0);
+        for (size_t i = 0; i < p.size(); i++) r[i + r.size() - p.size()] = p[i];
+        for (size_t i = 0; i < q.size(); i++) r[i + r.size() - q.size()] ^= q[i];
+        return r;
+    }
+
+    Poly poly_scale(const Poly& p, uint8_t x)
+    {
+        Poly r(p.size());
+        for (size_t i = 0; i < p.size(); i++) r[i] = gf().mul(p[i], x);
+        return r;
+    }
+
+    Poly poly_mul(const Poly& p, const Poly& q)
+    {
+        Poly r(p.size() + q.size() - 1, 0);
+        for (size_t j = 0; j < q.size(); j++)
+        {
+            for (size_t i = 0; i < p.size(); i++) r[i + j] ^= gf().mul(p[i], q[j]);
+        }
+        return r;
+    }
+
+    /// 除以首项为1的多项式，返回余数
+    Poly poly_mod(const Poly& dividend, const Poly& divisor)
+    {
+        Poly r = dividend;
+        for (size_t i = 0; i + divisor.size() <= dividend.size(); i++)
+        {
+            uint8_t coef = r[i];
+            if (coef == 0) continue;
+            for (size_t j = 1; j < divisor.size(); j++) r[i + j] ^= gf().mul(divisor[j], coef);
+        }
+        return Poly(r.end() - (long)(divisor.size() - 1), r.end());
+    }
+
+    /// 生成nsym个纠错码字（编码端，自测用）
+    Poly rs_encode(const Poly& data, int nsym)
+    {
+        Poly generator = { 1 };
+        forup (i, 0, nsym - 1) generator = poly_mul(generator, { 1, gf().pow2(i) });
+
+        Poly padded = data;
+        padded.resize(data.size() + nsym, 0);
+        return poly_mod(padded, generator);
+    }
+
+    /// 伴随式，前面多放一个0，下标和α的次数对齐
+    Poly rs_syndromes(const Poly& message, int nsym)
+    {
+        Poly synd(nsym + 1, 0);
+        forup (i, 0, nsym - 1) synd[i + 1] = poly_eval(message, gf().pow2(i));
+        return synd;
+    }
+
+    /// 擦除位置已知时的Forney伴随式，消掉擦除的影响后交给BM找未知错误
+    Poly rs_forney_syndromes(const Poly& synd, const vector<int>& positions, int length)
+    {
+        Poly fsynd(synd.begin() + 1, synd.end());
+        for (int position : positions)
+        {
+            uint8_t x = gf().pow2(length - 1 - position);
+            for (size_t j = 0; j + 1 < fsynd.size(); j++) fsynd[j] = gf().mul(fsynd[j], x) ^ fsynd[j + 1];
+        }
+        return fsynd;
+    }
+
+    /// Berlekamp-Massey求错误位置多项式
+    /// \return 未知错误加擦除超出纠错能力时返回空
+    Poly rs_error_locator(const Poly& synd, int nsym, int erase_count)
+    {
+        Poly err_loc = { 1 };
+        Poly old_loc = { 1 };
+        int shift = (int)synd.size() > nsym ? (int)synd.size() - nsym : 0;
+
+        forup (i, 0, nsym - erase_count - 1)
+        {
+            int k = i + shift;
+            uint8_t delta = synd[k];
+            for (int j = 1; j < (int)err_loc.size() && j <= k; j++) delta ^= gf().mul(err_loc[err_loc.size() - 1 - j], synd[k - j]);
+
+            old_loc.push_back(0);
+            if (delta == 0) continue;
+            if (old_loc.size() > err_loc.size())
+            {
+                Poly new_loc = poly_scale(old_loc, delta);
+                old_loc = poly_scale(err_loc, gf().inverse(delta));
+                err_loc = new_loc;
+            }
+            err_loc = poly_add(err_loc, poly_scale(old_loc, delta));
+        }
+
+        while (!err_loc.empty() && err_loc[0] == 0) err_loc.erase(err_loc.begin());
+        int errs = (int)err_loc.size() - 1;
+        if (errs * 2 + erase_count > nsym) return {};
+        return err_loc;
+    }
+
+    /// Chien搜索：错误位置多项式的根对应的码字下标
+    /// \return 根的个数和次数对不上时返回false
+    bool rs_find_errors(const Poly& err_loc, int length, vector<int>& positions)
+    {
+        Poly reversed(err_loc.rbegin(), err_loc.rend());
+        forup (i, 0, length - 1)
+        {
+            if (poly_eval(reversed, gf().pow2(i)) == 0) positions.push_back(length - 1 - i);
+        }
+        return positions.size() == err_loc.size() - 1;
+    }
+
+    /// Forney算法求错误值并改正
+    void rs_correct_errata(Poly& message, const Poly& synd, const vector<int>& positions)
+    {
+        int length = (int)message.size();
+
+        // 错误位置多项式 Π(1 + X_i x)
+        Poly err_loc = { 1 };
+        vector<uint8_t> x_values;
+        for (int position : positions)
+        {
+            int coef_pos = length - 1 - position;
+            err_loc = poly_mul(err_loc, { gf().pow2(coef_pos), 1 });
+            x_values.push_back(gf().pow2(coef_pos));
+        }
+
+        // 错误值多项式 Ω = S(x)Λ(x) mod x^(ν+1)
+        Poly synd_reversed(synd.rbegin(), synd.rend());
+        Poly modulus(err_loc.size() + 1, 0);
+        modulus[0] = 1;
+        Poly err_eval = poly_mod(poly_mul(synd_reversed, err_loc), modulus);
+
+        for (size_t i = 0; i < x_values.size(); i++)
+        {
+            uint8_t xi_inv = gf().inverse(x_values[i]);
+
+            uint8_t err_loc_prime = 1;
+            for (size_t j = 0; j < x_values.size(); j++)
+            {
+                if (j != i) err_loc_prime = gf().mul(err_loc_prime, 1 ^ gf().mul(xi_inv, x_values[j]));
+            }
+
+            uint8_t y = gf().mul(x_values[i], poly_eval(err_eval, xi_inv));
+            message[positions[i]] ^= gf().div(y, err_loc_prime);
+        }
+    }
+
+    /// 带擦除的RS纠错
+    /// \param message 数据码字+纠错码字，原地改正
+    /// \param nsym 纠错码字数
+    /// \param erasures 已知不可靠的码字下标
+    /// \return 2×错误数+擦除数超过nsym或改正后伴随式不为0时返回false
+    bool rs_decode(Poly& message, int nsym, const vector<int>& erasures)
+    {
+        if ((int)erasures.size() > nsym) return false;
+        for (int position : erasures) message[position] = 0;
+
+        Poly synd = rs_syndromes(message, nsym);
+        if (all_of(synd.begin(), synd.end(), [](uint8_t s) { return s == 0; })) return true;
+
+        Poly fsynd = rs_forney_syndromes(synd, erasures, (int)message.size());
+        Poly err_loc = rs_error_locator(fsynd, nsym, (int)erasures.size());
+        if (err_loc.empty()) return false;
+
+        vector<int> errors;
+        if (!rs_find_errors(err_loc, (int)message.size(), errors)) return false;
+
+        vector<int> positions = erasures;
+        positions.insert(positions.end(), errors.begin(), errors.end());
+        rs_correct_errata(message, synd, positions);
+
+        synd = rs_syndromes(message, nsym);
+        return all_of(synd.begin(), synd.end(), [](uint8_t s) { return s == 0; });
+    }
+
+    int symbol_size(int version)
+    {
+        return version * 4 + 17;
+    }
+
+    /// 校正图形的中心坐标（行列相同）
+    vector<int> alignment_positions(int version)
+    {
+        if (version == 1) return {};
+        int count = version / 7 + 2;
+        int step = version == 32 ? 26 : (version * 4 + count * 2 + 1) / (count * 2 - 2) * 2;
+        vector<int> res = { 6 };
+        for (int pos = symbol_size(version) - 7; (int)res.size() < count; pos -= step) res.insert(res.begin() + 1, pos);
+        return res;
+    }
+
+    /// 除功能图形外放数据的模块数
+    int raw_data_modules(int version)
+    {
+        int res = (16 * version + 128) * version + 64;
+        if (version >= 2)
+        {
+            int count = version / 7 + 2;
+            res -= (25 * count - 10) * count - 55;
+            if (version >= 7) res -= 36;
+        }
+        return res;
+    }
+
+    /// 功能图形（定位、分隔、时序、校正、格式和版本信息）的位置，按行优先存放
+    vector<bool> function_modules(int version)
+    {
+        int size = symbol_size(version);
+        vector<bool> res(size * size, false);
+        auto mark = [&](int top, int left, int height, int width)
+        {
+            forup (y, max(0, top), min(size, top + height) - 1)
+                forup (x, max(0, left), min(size, left + width) - 1) res[y * size + x] = true;
+        };
+
+        // 三个定位图形连同分隔符和格式信息
+        mark(0, 0, 9, 9);
+        mark(0, size - 8, 9, 8);
+        mark(size - 8, 0, 8, 9);
+        // 时序图形
+        mark(6, 0, 1, size);
+        mark(0, 6, size, 1);
+
+        vector<int> positions = alignment_positions(version);
+        int count = (int)positions.size();
+        forup (i, 0, count - 1)
+        {
+            forup (j, 0, count - 1)
+            {
+                // 和定位图形重叠的三个不画
+                if ((i == 0 && j == 0) || (i == 0 && j == count - 1) || (i == count - 1 && j == 0)) continue;
+                mark(positions[i] - 2, positions[j] - 2, 5, 5);
+            }
+        }
+
+        if (version >= 7)
+        {
+            mark(0, size - 11, 6, 3);
+            mark(size - 11, 0, 3, 6);
+        }
+        return res;
+    }
+
+    bool mask_bit(int mask, int x, int y)
+    {
+        switch (mask)
+        {
+            case 0: return (x + y) % 2 == 0;
+            case 1: return y % 2 == 0;
+            case 2: return x % 3 == 0;
+            case 3: return (x + y) % 3 == 0;
+            case 4: return (x / 3 + y / 2) % 2 == 0;
+            case 5: return x * y % 2 + x * y % 3 == 0;
+            case 6: return (x * y % 2 + x * y % 3) % 2 == 0;
+            default: return ((x + y) % 2 + x * y % 3) % 2 == 0;
+        }
+    }
+
+    /// 纠错等级在格式信息里的两位编码
+    int ecl_format_bits(int ecl)
+    {
+        static const int bits[4] = { 1, 0, 3, 2 };
+        return bits[ecl];
+    }
+
+    /// 15位格式信息（已经异或过0x5412）
+    int format_bits(int ecl, int mask)
+    {
+        int data = ecl_format_bits(ecl) << 3 | mask;
+        int rem = data;
+        forup (i, 1, 10) rem = (rem << 1) ^ ((rem >> 9) * 0x537);
+        return (data << 10 | rem) ^ 0x5412;
+    }
+
+    /// 格式信息两份拷贝中第i位的模块坐标（x为列，y为行）
+    void format_positions(int size, int i, int& x1, int& y1, int& x2, int& y2)
+    {
+        if (i < 6) { x1 = 8; y1 = i; }
+        else if (i == 6) { x1 = 8; y1 = 7; }
+        else if (i == 7) { x1 = 8; y1 = 8; }
+        else if (i == 8) { x1 = 7; y1 = 8; }
+        else { x1 = 14 - i; y1 = 8; }
+
+        if (i < 8) { x2 = size - 1 - i; y2 = 8; }
+        else { x2 = 8; y2 = size - 15 + i; }
+    }
+
+    /// 一个采样好的符号：每个模块是否为深色，以及判决的置信度（0~1）
+    struct SampledSymbol
+    {
+        int version = 0;
+        vector<bool> dark;
+        vector<float> confidence;
+
+        int size() const
+        {
+            return symbol_size(version);
+        }
+    };
+
+    /// 用定位图形里已知颜色的模块估计深浅两色的亮度，对每个模块做判决
+    /// \param version
+    /// \param intensity 每个模块中心的采样亮度，按行优先，越小越深
+    /// \return
+    SampledSymbol classify_modules(int version, const vector<float>& intensity)
+    {
+        SampledSymbol symbol;
+        symbol.version = version;
+        int size = symbol.size();
+
+        // 定位图形：外圈深、中间一圈浅、中心3x3深，外面一圈分隔符浅
+        double dark_sum = 0, light_sum = 0;
+        int dark_count = 0, light_count = 0;
+        int origins[3][2] = { { 0, 0 }, { size - 7, 0 }, { 0, size - 7 } };
+        for (auto& origin : origins)
+        {
+            forup (dy, -1, 7)
+            {
+                forup (dx, -1, 7)
+                {
+                    int x = origin[0] + dx, y = origin[1] + dy;
+                    if (x < 0 || y < 0 || x >= size || y >= size) continue;
+                    int ring = max(abs(dx - 3), abs(dy - 3));
+                    bool is_dark = ring != 2 && ring != 4;
+                    (is_dark ? dark_sum : light_sum) += intensity[y * size + x];
+                    (is_dark ? dark_count : light_count)++;
+                }
+            }
+        }
+        float dark_level = (float)(dark_sum / max(1, dark_count));
+        float light_level = (float)(light_sum / max(1, light_count));
+        float threshold = (dark_level + light_level) / 2;
+        float half_spread = max(1e-3f, fabs(light_level - dark_level) / 2);
+        bool inverted = light_level < dark_level;
+
+        symbol.dark.resize(size * size);
+        symbol.confidence.resize(size * size);
+        forup (i, 0, size * size - 1)
+        {
+            symbol.dark[i] = (intensity[i] < threshold) != inverted;
+            symbol.confidence[i] = min(1.0f, fabs(intensity[i] - threshold) / half_spread);
+        }
+        return symbol;
+    }
+
+    /// 读格式信息，和32个合法码字比较取汉明距离最小的
+    /// \return 两份拷贝都差超过3位时返回false
+    bool decode_format(const SampledSymbol& symbol, int& ecl, int& mask)
+    {
+        int size = symbol.size();
+        int copies[2] = { 0, 0 };
+        forup (i, 0, 14)
+        {
+            int x1, y1, x2, y2;
+            format_positions(size, i, x1, y1, x2, y2);
+            if (symbol.dark[y1 * size + x1]) copies[0] |= 1 << i;
+            if (symbol.dark[y2 * size + x2]) copies[1] |= 1 << i;
+        }
+
+        int best_distance = 16;
+        forup (level, 0, 3)
+        {
+            forup (candidate, 0, 7)
+            {
+                int bits = format_bits(level, candidate);
+                for (int copy : copies)
+                {
+                    int distance = __builtin_popcount(bits ^ copy);
+                    if (distance < best_distance)
+                    {
+                        best_distance = distance;
+                        ecl = level;
+                        mask = candidate;
+                    }
+                }
+            }
+        }
+        return best_distance <= 3;
+    }
+
+    /// 按之字形顺序读出所有数据模块，去掉掩码，每8位拼成一个码字
+    /// \param codewords
+    /// \param reliability 每个码字里置信度最低的模块的置信度
+    void read_codewords(const SampledSymbol& symbol, int mask, vector<uint8_t>& codewords, vector<float>& reliability)
+    {
+        int size = symbol.size();
+        vector<bool> is_function = function_modules(symbol.version);
+        int total = raw_data_modules(symbol.version) / 8;
+        codewords.assign(total, 0);
+        reliability.assign(total, 1.0f);
+
+        int bit = 0;
+        for (int right = size - 1; right >= 1; right -= 2)
+        {
+            if (right == 6) right = 5;
+            forup (vert, 0, size - 1)
+            {
+                forup (j, 0, 1)
+                {
+                    int x = right - j;
+                    bool upward = ((right + 1) & 2) == 0;
+                    int y = upward ? size - 1 - vert : vert;
+                    if (is_function[y * size + x] || bit >= total * 8) continue;
+
+                    int pos = y * size + x;
+                    bool value = symbol.dark[pos] != mask_bit(mask, x, y);
+                    if (value) codewords[bit >> 3] |= 0x80 >> (bit & 7);
+                    reliability[bit >> 3] = min(reliability[bit >> 3], symbol.confidence[pos]);
+                    bit++;
+                }
+            }
+        }
+    }
+
+    /// 块的划分：前面的短块数据少一个码字
+    struct BlockLayout
+    {
+        int block_count;
+        int ecc_len;
+        int short_count;
+        int short_len;
+
+        int data_len(int block) const
+        {
+            return short_len - ecc_len + (block < short_count ? 0 : 1);
+        }
+    };
+
+    BlockLayout block_layout(int version, int ecl)
+    {
+        BlockLayout layout;
+        int total = raw_data_modules(version) / 8;
+        layout.block_count = NUM_ERROR_CORRECTION_BLOCKS[ecl][version];
+        layout.ecc_len = ECC_CODEWORDS_PER_BLOCK[ecl][version];
+        layout.short_count = layout.block_count - total % layout.block_count;
+        layout.short_len = total / layout.block_count;
+        return layout;
+    }
+
+    /// 把交织的码字按块拆开，每块是数据码字+纠错码字
+    /// \param values 码字或它们的可靠度，和codewords同序
+    template<class T>
+    vector<vector<T>> deinterleave(const vector<T>& values, const BlockLayout& layout)
+    {
+        vector<vector<T>> blocks(layout.block_count);
+        size_t k = 0;
+        // 数据部分：短块在最后一列没有码字
+        forup (i, 0, layout.short_len - layout.ecc_len)
+        {
+            forup (j, 0, layout.block_count - 1)
+            {
+                if (i == layout.short_len - layout.ecc_len && j < layout.short_count) continue;
+                blocks[j].push_back(values[k++]);
+            }
+        }
+        forup (i, 0, layout.ecc_len - 1)
+        {
+            forup (j, 0, layout.block_count - 1) blocks[j].push_back(values[k++]);
+        }
+        return blocks;
+    }
+
+    /// 从数据码字里解析数据段，支持数字、字母数字和字节模式
+    /// \return 格式有误返回false
+    bool parse_segments(const vector<uint8_t>& data, int version, vector<uint8_t>& output)
+    {
+        size_t bit = 0;
+        auto read = [&](int count) -> int
+        {
+            int value = 0;
+            forup (i, 1, count)
+            {
+                if (bit >= data.size() * 8) return -1;
+                value = value << 1 | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+                bit++;
+            }
+            return value;
+        };
+        int size_class = version <= 9 ? 0 : version <= 26 ? 1 : 2;
+        static const char* ALPHANUMERIC = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+        while (bit + 4 <= data.size() * 8)
+        {
+            int mode = read(4);
+            if (mode == 0) break;
+
+            if (mode == 0x7)
+            {
+                // ECI：只认单字节的指示符，内容原样输出
+                if (read(8) < 0) return false;
+                continue;
+            }
+            if (mode == 0x4)
+            {
+                static const int bits[3] = { 8, 16, 16 };
+                int count = read(bits[size_class]);
+                if (count < 0) return false;
+                forup (i, 1, count)
+                {
+                    int value = read(8);
+                    if (value < 0) return false;
+                    output.push_back((uint8_t)value);
+                }
+                continue;
+            }
+            if (mode == 0x1)
+            {
+                static const int bits[3] = { 10, 12, 14 };
+                int count = read(bits[size_class]);
+                if (count < 0) return false;
+                for (; count >= 3; count -= 3)
+                {
+                    int value = read(10);
+                    if (value < 0 || value > 999) return false;
+                    output.push_back('0' + value / 100);
+                    output.push_back('0' + value / 10 % 10);
+                    output.push_back('0' + value % 10);
+                }
+                if (count > 0)
+                {
+                    int value = read(count == 2 ? 7 : 4);
+                    if (value < 0) return false;
+                    if (count == 2) output.push_back('0' + value / 10);
+                    output.push_back('0' + value % 10);
+                }
+                continue;
+            }
+            if (mode == 0x2)
+            {
+                static const int bits[3] = { 9, 11, 13 };
+                int count = read(bits[size_class]);
+                if (count < 0) return false;
+                for (; count >= 2; count -= 2)
+                {
+                    int value = read(11);
+                    if (value < 0 || value >= 45 * 45) return false;
+                    output.push_back(ALPHANUMERIC[value / 45]);
+                    output.push_back(ALPHANUMERIC[value % 45]);
+                }
+                if (count == 1)
+                {
+                    int value = read(6);
+                    if (value < 0 || value >= 45) return false;
+                    output.push_back(ALPHANUMERIC[value]);
+                }
+                continue;
+            }
+            // 汉字等其他模式不支持
+            return false;
+        }
+        return true;
+    }
+
+    /// 纠错一块：先把最不可靠的码字当擦除，不行再少擦除一些留出纠未知错误的余量
+    /// 擦除最多ecc_len - ERASURE_SPARE个：擦除用满纠错码字时RS没有余量发现擦除以外的错误，
+    /// 总能"纠"出一个合法但错误的码字，留两个码字才能纠一个未知错误或发现更多的错误
+    static constexpr int ERASURE_SPARE = 2;
+
+    bool correct_block(vector<uint8_t>& block, const vector<float>& reliability, int ecc_len, float erasure_threshold)
+    {
+        vector<int> order;
+        forup (i, 0, (int)block.size() - 1)
+        {
+            if (reliability[i] < erasure_threshold) order.push_back(i);
+        }
+        sort(order.begin(), order.end(), [&](int a, int b) { return reliability[a] < reliability[b]; });
+
+        for (int limit : { max(0, ecc_len - ERASURE_SPARE), ecc_len / 2, 0 })
+        {
+            vector<uint8_t> attempt = block;
+            vector<int> erasures(order.begin(), order.begin() + min((int)order.size(), limit));
+            if (rs_decode(attempt, ecc_len, erasures))
+            {
+                block = attempt;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// 解码一个采样好的符号
+    /// \param symbol
+    /// \param output 解出的数据追加到这里
+    /// \param erasure_threshold 置信度低于它的模块所在码字作为擦除
+    /// \return
+    bool decode_symbol(const SampledSymbol& symbol, vector<uint8_t>& output, float erasure_threshold = 0.35f)
+    {
+        if (symbol.version < 1 || symbol.version > 40) return false;
+
+        int ecl = 0, mask = 0;
+        if (!decode_format(symbol, ecl, mask)) return false;
+
+        vector<uint8_t> codewords;
+        vector<float> reliability;
+        read_codewords(symbol, mask, codewords, reliability);
+
+        BlockLayout layout = block_layout(symbol.version, ecl);
+        vector<vector<uint8_t>> blocks = deinterleave(codewords, layout);
+        vector<vector<float>> block_reliability = deinterleave(reliability, layout);
+
+        vector<uint8_t> data;
+        forup (j, 0, layout.block_count - 1)
+        {
+            if (!correct_block(blocks[j], block_reliability[j], layout.ecc_len, erasure_threshold)) return false;
+            data.insert(data.end(), blocks[j].begin(), blocks[j].begin() + layout.data_len(j));
+        }
+
+        vector<uint8_t> res;
+        if (!parse_segments(data, symbol.version, res)) return false;
+        output.insert(output.end(), res.begin(), res.end());
+        return true;
+    }
+}
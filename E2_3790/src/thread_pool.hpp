@@ -0,0 +1,81 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/// 固定大小的线程池，任务先进先出
+class ThreadPool
+{
+public:
+    /// \param thread_count 为0时取CPU核数
+    explicit ThreadPool(size_t thread_count = 0)
+    {
+        if (thread_count == 0) thread_count = max(1u, thread::hardware_concurrency());
+        for (size_t i = 0; i < thread_count; i++)
+        {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            stopping = true;
+        }
+        task_ready.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+
+    void submit(function<void()> task)
+    {
+        {
+            lock_guard<mutex> lock(tasks_mutex);
+            tasks.push(std::move(task));
+            unfinished++;
+        }
+        task_ready.notify_one();
+    }
+
+    /// 阻塞到已提交的任务全部执行完
+    void wait()
+    {
+        unique_lock<mutex> lock(tasks_mutex);
+        all_done.wait(lock, [this]() { return unfinished == 0; });
+    }
+
+private:
+    void work()
+    {
+        while (true)
+        {
+            function<void()> task;
+            {
+                unique_lock<mutex> lock(tasks_mutex);
+                task_ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (tasks.empty()) return;
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+
+            task();
+
+            lock_guard<mutex> lock(tasks_mutex);
+            if (--unfinished == 0) all_done.notify_all();
+        }
+    }
+
+    vector<thread> workers;
+    queue<function<void()>> tasks;
+    mutex tasks_mutex;
+    condition_variable task_ready;
+    condition_variable all_done;
+    size_t unfinished = 0;
+    bool stopping = false;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace trace
+{
+    /// 一段耗时区间，name必须是字符串常量（只存指针）
+    struct Event
+    {
+        const char* name;
+        uint64_t begin_us;
+        uint64_t end_us;
+    };
+
+    /// 单个线程的事件缓冲区，只有所属线程写入，写满后覆盖最旧的事件
+    /// 写入者用release发布head，导出时用acquire读取，记录过程中不加锁
+    struct ThreadBuffer
+    {
+        static constexpr size_t CAPACITY = 1 << 16;
+
+        explicit ThreadBuffer(int tid) : tid(tid), events(CAPACITY) {}
+
+        void push(const Event& event)
+        {
+            size_t current = head.load(memory_order_relaxed);
+            events[current % CAPACITY] = event;
+            head.store(current + 1, memory_order_release);
+        }
+
+        int tid;
+        vector<Event> events;
+        atomic<size_t> head{0};
+    };
+
+    /// 所有线程缓冲区的登记表，每个线程只在第一次记录时加一次锁
+    class Registry
+    {
+    public:
+        ThreadBuffer* create_buffer()
+        {
+            lock_guard<mutex> lock(buffers_mutex);
+            buffers.push_back(make_unique<ThreadBuffer>((int)buffers.size() + 1));
+            return buffers.back().get();
+        }
+
+        /// 导出为Chrome trace-event格式（Perfetto/chrome://tracing可直接打开）
+        /// \param path 输出路径
+        /// \return
+        bool write_chrome_trace(const string& path)
+        {
+            ofstream file(path);
+            if (!file.is_open()) return false;
+
+            lock_guard<mutex> lock(buffers_mutex);
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            bool first = true;
+            for (auto& buffer : buffers)
+            {
+                if (!first) file << ',';
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid
+                     << ",\"args\":{\"name\":\"thread-" << buffer->tid << "\"}}";
+                first = false;
+
+                size_t head = buffer->head.load(memory_order_acquire);
+                size_t begin = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+                for (size_t i = begin; i < head; i++)
+                {
+                    const Event& event = buffer->events[i % ThreadBuffer::CAPACITY];
+                    file << ",{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+                         << ",\"ts\":" << event.begin_us << ",\"dur\":" << event.end_us - event.begin_us << '}';
+                }
+            }
+            file << "]}" << endl;
+            return true;
+        }
+
+    private:
+        mutex buffers_mutex;
+        vector<unique_ptr<ThreadBuffer>> buffers;
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    atomic<bool>& enabled()
+    {
+        static atomic<bool> flag{false};
+        return flag;
+    }
+
+    uint64_t now_us()
+    {
+        static const auto origin = chrono::steady_clock::now();
+        return (uint64_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - origin).count();
+    }
+
+    ThreadBuffer& local_buffer()
+    {
+        thread_local ThreadBuffer* buffer = registry().create_buffer();
+        return *buffer;
+    }
+
+    /// 作用域区间，没开启追踪时只有一次原子读
+    class Span
+    {
+    public:
+        explicit Span(const char* name) : name(name), active(enabled().load(memory_order_relaxed))
+        {
+            if (active) begin_us = now_us();
+        }
+
+        ~Span()
+        {
+            end();
+        }
+
+        void end()
+        {
+            if (!active) return;
+            local_buffer().push({ name, begin_us, now_us() });
+            active = false;
+        }
+
+    private:
+        const char* name;
+        bool active;
+        uint64_t begin_us = 0;
+    };
+}
@@ -1,5 +1,6 @@
 #include <string>
 #include <iostream>
+#include <sstream>
 #include <opencv2/opencv.hpp>
 
 #define forup(i, l, r) for (int i = l; i <= r; i++)
@@ -15,9 +16,9 @@
 using namespace std;
 using namespace cv;
 
-void print_progress_bar(int progress, int total, const string& info = string(""), int length = 50)
+void print_progress_bar(double progress, double total, const string& info = string(""), int length = 50)
 {
-    float percentage = (float) progress / total;
+    float percentage = total > 0 ? (float)(progress / total) : 1;
     int filled_length = percentage * length;
 
     string bar(filled_length, '#');
@@ -37,7 +38,7 @@ bool are_images_identical(const Mat& img1, const Mat& img2)
         return false;
     }
 
-    return norm(img1, img2) != 0;
+    return norm(img1, img2, NORM_INF) == 0;
 }
 
 /// 逐字节比较函数
@@ -302,6 +303,47 @@ void draw_detect_line(Mat& src, const Mat& box)
     }
 }
 
+/// 读取形如"--name value"的命令行选项
+/// \param name 选项名（带--）
+/// \param default_value 没有该选项时返回的值
+/// \return
+string get_option(int argc, char** argv, const string& name, const string& default_value = string(""))
+{
+    forup (i, 1, argc - 2)
+    {
+        if (name == argv[i]) return argv[i + 1];
+    }
+    return default_value;
+}
+
+/// 是否有形如"--name"的开关选项
+/// \param name 选项名（带--）
+/// \return
+bool has_flag(int argc, char** argv, const string& name)
+{
+    forup (i, 1, argc - 1)
+    {
+        if (name == argv[i]) return true;
+    }
+    return false;
+}
+
+/// 按分隔符拆分成浮点数列表，如"0,0.5,1"
+/// \param text
+/// \param delimiter
+/// \return
+vector<double> split_to_doubles(const string& text, char delimiter = ',')
+{
+    vector<double> res;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, delimiter))
+    {
+        if (!item.empty()) res.push_back(stod(item));
+    }
+    return res;
+}
+
 /// 输出文件内容的十六进制
 /// \param filename
 /// \return
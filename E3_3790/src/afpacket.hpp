@@ -0,0 +1,222 @@
+#pragma once
+
+// Linux 的 AF_PACKET + TPACKET_V3 抓包：内核把包直接写进和用户态共享的内存环，按块（block）批量交给用户态
+// 不经过 libpcap 的逐包拷贝；多个线程的 socket 加入同一个 PACKET_FANOUT 组，内核按流哈希把包分给它们
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "pipeline.hpp"
+
+class AfPacketRing
+{
+public:
+    // 只需要 L2/L3 头，每个包只截前 96 字节，同样大小的环能多放好几倍的包
+    static constexpr uint32_t SNAPLEN = 96;
+    static constexpr uint32_t BLOCK_SIZE = 1 << 22;
+    // 所有环加起来最多这么多块（共 256 MB），按线程数平分；每个环至少 MIN_BLOCKS 块
+    static constexpr uint32_t TOTAL_BLOCKS = 64;
+    static constexpr uint32_t MIN_BLOCKS = 4;
+    static constexpr uint32_t FRAME_SIZE = 2048;
+    // 块没写满时最多等这么久就交给用户态（毫秒）
+    static constexpr uint32_t BLOCK_TIMEOUT = 60;
+
+    AfPacketRing() = default;
+    AfPacketRing(const AfPacketRing &) = delete;
+    AfPacketRing &operator=(const AfPacketRing &) = delete;
+
+    ~AfPacketRing()
+    {
+        close();
+    }
+
+    // rings 个环共用 TOTAL_BLOCKS 块时每个环分到的块数
+    static uint32_t blocks_per_ring(int rings)
+    {
+        uint32_t blocks = TOTAL_BLOCKS / (uint32_t)(rings > 0 ? rings : 1);
+        return blocks < MIN_BLOCKS ? MIN_BLOCKS : blocks;
+    }
+
+    // 在网卡 interface 上打开一个 blocks 块的环，fanout_group 相同的环平分流量
+    // 失败返回 false，原因写进 error
+    bool open(const char *interface, int fanout_group, uint32_t blocks, char *error, size_t error_size)
+    {
+        block_count = blocks;
+        fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+        if (fd < 0)
+        {
+            return fail("socket", error, error_size);
+        }
+
+        int version = TPACKET_V3;
+        if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0)
+        {
+            return fail("PACKET_VERSION", error, error_size);
+        }
+
+        // 相当于 BPF 程序 "ret #96"：接收所有包，但只保留前 96 字节
+        sock_filter code[] = {{BPF_RET | BPF_K, 0, 0, SNAPLEN}};
+        sock_fprog filter = {1, code};
+        if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &filter, sizeof(filter)) < 0)
+        {
+            return fail("SO_ATTACH_FILTER", error, error_size);
+        }
+
+        tpacket_req3 req{};
+        req.tp_block_size = BLOCK_SIZE;
+        req.tp_block_nr = block_count;
+        req.tp_frame_size = FRAME_SIZE;
+        req.tp_frame_nr = BLOCK_SIZE / FRAME_SIZE * block_count;
+        req.tp_retire_blk_tov = BLOCK_TIMEOUT;
+        req.tp_feature_req_word = TP_FT_REQ_FILL_RXHASH;
+        if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+        {
+            return fail("PACKET_RX_RING", error, error_size);
+        }
+
+        map_size = (size_t)BLOCK_SIZE * block_count;
+        void *mapped = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            // 内存锁定额度不够时退回不锁定
+            mapped = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (mapped == MAP_FAILED)
+        {
+            map_size = 0;
+            return fail("mmap", error, error_size);
+        }
+        ring = (uint8_t *)mapped;
+
+        sockaddr_ll address{};
+        address.sll_family = AF_PACKET;
+        address.sll_protocol = htons(ETH_P_ALL);
+        address.sll_ifindex = (int)if_nametoindex(interface);
+        if (address.sll_ifindex == 0)
+        {
+            return fail(interface, error, error_size);
+        }
+        if (bind(fd, (sockaddr *)&address, sizeof(address)) < 0)
+        {
+            return fail("bind", error, error_size);
+        }
+
+        // 按流哈希分配，同一条流的两个方向都落到同一个 socket
+        int fanout = (fanout_group & 0xffff) | (PACKET_FANOUT_HASH << 16);
+        if (setsockopt(fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout)) < 0)
+        {
+            return fail("PACKET_FANOUT", error, error_size);
+        }
+        return true;
+    }
+
+    // 等到有块可读（最多 timeout_ms 毫秒），把每个就绪块里的包交给 on_batch(packets, n) 后归还给内核
+    // 包的数据直接指向环形缓冲区，on_batch 返回后就失效
+    // 返回处理的包数，出错返回 -1
+    template <typename F>
+    int poll_blocks(F on_batch, int timeout_ms)
+    {
+        int total = 0;
+        while (true)
+        {
+            auto *block = (tpacket_block_desc *)(ring + (size_t)current * BLOCK_SIZE);
+            if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+            {
+                if (total)
+                {
+                    return total;
+                }
+                pollfd pfd{fd, POLLIN | POLLERR, 0};
+                int res = ::poll(&pfd, 1, timeout_ms);
+                if (res < 0 && errno != EINTR)
+                {
+                    return -1;
+                }
+                if (res <= 0)
+                {
+                    return 0;
+                }
+                // 只等一次，醒了之后把就绪的块都处理完
+                timeout_ms = 0;
+                if (!(__atomic_load_n(&block->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+                {
+                    return 0;
+                }
+            }
+
+            uint32_t n = block->hdr.bh1.num_pkts;
+            batch.resize(n);
+            auto *packet = (tpacket3_hdr *)((uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+            for (uint32_t i = 0; i < n; i++)
+            {
+                batch[i] = packet_view{packet->tp_sec, (int32_t)(packet->tp_nsec / 1000), packet->tp_snaplen,
+                                       packet->tp_len, (const uint8_t *)packet + packet->tp_mac};
+                packet = (tpacket3_hdr *)((uint8_t *)packet + packet->tp_next_offset);
+            }
+            on_batch(batch.data(), (size_t)n);
+            total += (int)n;
+
+            __atomic_store_n(&block->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+            current = (current + 1) % block_count;
+        }
+    }
+
+    // 自上次调用以来内核收到和因为环满丢弃的包数（读一次内核就清零）
+    bool stats(uint64_t &packets, uint64_t &drops)
+    {
+        tpacket_stats_v3 value{};
+        socklen_t size = sizeof(value);
+        if (getsockopt(fd, SOL_PACKET, PACKET_STATISTICS, &value, &size) < 0)
+        {
+            return false;
+        }
+        packets = value.tp_packets;
+        drops = value.tp_drops;
+        return true;
+    }
+
+    void close()
+    {
+        if (ring)
+        {
+            munmap(ring, map_size);
+            ring = nullptr;
+        }
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+private:
+    bool fail(const char *what, char *error, size_t error_size)
+    {
+        snprintf(error, error_size, "%s: %s", what, strerror(errno));
+        close();
+        return false;
+    }
+
+    int fd = -1;
+    uint8_t *ring = nullptr;
+    size_t map_size = 0;
+    uint32_t block_count = 0;
+    uint32_t current = 0;
+    std::vector<packet_view> batch;
+};
+
+#endif
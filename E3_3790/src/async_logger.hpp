@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+#include "spsc_ring.hpp"
+
+// 日志里一个包的二进制记录，只存原始字段，格式化留给写线程
+struct packet_record
+{
+    int64_t ts_sec;             // pcap_pkthdr::ts
+    int32_t ts_usec;
+    uint32_t len;               // 包长
+    uint8_t src_mac[6];
+    uint8_t dst_mac[6];
+    uint8_t ip_version;         // 4 或 6；ARP 等不是 IP 的包为 0，IP 列留空
+    uint8_t src_ip[16];         // 网络字节序，IPv4 只用前 4 字节
+    uint8_t dst_ip[16];
+};
+
+// 异步日志：处理线程只把记录放进环形队列，写线程攒一批格式化成 CSV 后一次写出
+// 每个生产者线程一个队列，都是单生产者单消费者，不需要锁
+class AsyncLogger
+{
+public:
+    // file 为 CSV 日志，echo 为 true 时同样的内容也写到控制台，producers 为往里写的线程数
+    AsyncLogger(FILE *file, bool echo, int producers = 1, size_t capacity = 1 << 16)
+        : file(file), echo(echo)
+    {
+        for (int i = 0; i < producers; i++)
+        {
+            rings.push_back(std::make_unique<SpscRing<packet_record>>(capacity));
+        }
+        writer = std::thread([this]() { run(); });
+    }
+
+    ~AsyncLogger()
+    {
+        stop();
+    }
+
+    // 第 producer 个生产者线程调用；队列满了就丢掉这条并计数，不阻塞抓包
+    void log(const packet_record &record, int producer = 0)
+    {
+        if (!rings[producer]->try_push(record))
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // 写完队列里剩下的记录后退出写线程
+    void stop()
+    {
+        if (!writer.joinable())
+        {
+            return;
+        }
+        running.store(false, std::memory_order_release);
+        writer.join();
+    }
+
+    uint64_t dropped_count() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr size_t BATCH = 4096;
+    // 一行最长：时间 19 + MAC 17 * 2 + IPv6 45 * 2 + 长度 10 + 逗号和换行 6
+    static constexpr size_t MAX_LINE = 160;
+
+    void run()
+    {
+        std::vector<packet_record> batch(BATCH);
+        std::vector<char> buffer(BATCH * MAX_LINE);
+        while (true)
+        {
+            // 先读标志再取数据，保证退出前最后一次取空了队列
+            bool stopping = !running.load(std::memory_order_acquire);
+            size_t total = 0;
+            for (auto &ring : rings)
+            {
+                size_t n = ring->pop_batch(batch.data(), BATCH);
+                if (n == 0)
+                {
+                    continue;
+                }
+                total += n;
+
+                char *p = buffer.data();
+                for (size_t i = 0; i < n; i++)
+                {
+                    p = format_record(batch[i], p);
+                }
+                fwrite(buffer.data(), 1, p - buffer.data(), file);
+                if (echo)
+                {
+                    fwrite(buffer.data(), 1, p - buffer.data(), stdout);
+                }
+            }
+            if (total == 0)
+            {
+                if (stopping)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        fflush(file);
+        if (echo)
+        {
+            fflush(stdout);
+        }
+    }
+
+    // 同一秒内的包共用一次 localtime/strftime 的结果
+    // 流表导出在别的线程里也要转本地时间，用可重入的版本，不共享 localtime 的静态缓冲区
+    const char *timestamp(int64_t sec)
+    {
+        if (sec != cached_sec)
+        {
+            time_t raw = (time_t)sec;
+            tm timeInfo;
+#ifdef _WIN32
+            localtime_s(&timeInfo, &raw);
+#else
+            localtime_r(&raw, &timeInfo);
+#endif
+            strftime(cached_time, sizeof(cached_time), "%Y-%m-%d %H:%M:%S", &timeInfo);
+            cached_sec = sec;
+        }
+        return cached_time;
+    }
+
+    static char *append_mac(char *p, const uint8_t *mac)
+    {
+        static const char hex[] = "0123456789ABCDEF";
+        for (int i = 0; i < 6; i++)
+        {
+            if (i)
+            {
+                *p++ = '-';
+            }
+            *p++ = hex[mac[i] >> 4];
+            *p++ = hex[mac[i] & 15];
+        }
+        return p;
+    }
+
+    static char *append_uint(char *p, uint32_t value)
+    {
+        char digits[10];
+        int n = 0;
+        do
+        {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (n)
+        {
+            *p++ = digits[--n];
+        }
+        return p;
+    }
+
+    // 网络字节序的 IPv4 地址，写成点分十进制
+    static char *append_ipv4(char *p, const uint8_t *bytes)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            if (i)
+            {
+                *p++ = '.';
+            }
+            p = append_uint(p, bytes[i]);
+        }
+        return p;
+    }
+
+    // IPv6 地址的压缩写法比较繁琐，交给 inet_ntop；不是 IP 的包什么都不写
+    static char *append_ip(char *p, uint8_t version, const uint8_t *addr)
+    {
+        if (version == 4)
+        {
+            return append_ipv4(p, addr);
+        }
+        if (version == 6)
+        {
+            inet_ntop(AF_INET6, addr, p, INET6_ADDRSTRLEN);
+            return p + strlen(p);
+        }
+        return p;
+    }
+
+    // 和原来的格式一致：时间,源MAC,源IP,目的MAC,目的IP,长度
+    char *format_record(const packet_record &record, char *p)
+    {
+        const char *time_str = timestamp(record.ts_sec);
+        size_t time_len = strlen(time_str);
+        memcpy(p, time_str, time_len);
+        p += time_len;
+        *p++ = ',';
+        p = append_mac(p, record.src_mac);
+        *p++ = ',';
+        p = append_ip(p, record.ip_version, record.src_ip);
+        *p++ = ',';
+        p = append_mac(p, record.dst_mac);
+        *p++ = ',';
+        p = append_ip(p, record.ip_version, record.dst_ip);
+        *p++ = ',';
+        p = append_uint(p, record.len);
+        *p++ = '\n';
+        return p;
+    }
+
+    FILE *file;
+    bool echo;
+    std::vector<std::unique_ptr<SpscRing<packet_record>>> rings;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> dropped{0};
+    std::thread writer;
+
+    int64_t cached_sec = -1;
+    char cached_time[32] = "";
+};
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <pcap.h>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#endif
+
+// 命令行选项
+struct capture_options
+{
+    std::string read_file;      // --read file.pcap：从抓包文件回放，不打开网卡
+    bool max_speed = false;     // --max-speed：回放时不按包的时间戳等待，能跑多快跑多快
+    bool quiet = false;         // --quiet：逐包记录只写日志文件，不输出到控制台
+    int workers = 0;            // --workers N：处理包的工作线程数，0 为按 CPU 核数自动选
+    std::string interface;      // --interface 网卡名：直接打开这块网卡，不交互选择
+    std::string backend = "pcap";   // --backend pcap|afpacket：抓包方式，afpacket 只有 Linux 支持，需要 --interface
+    int top = 0;                // --top K：只统计流量最大的 K 个地址，内存和报告开销固定，0 为精确统计所有地址
+    std::vector<std::string> queries;   // --query 地址：--top 模式下报告时再给出这些 IP 或 MAC 地址的流量估计，可以给多次
+    std::string flows;          // --flows 文件名：按五元组统计流，结束的流导出到这个文件
+    bool flow_csv = true;       // --flow-format csv|binary：流导出成 CSV，或者每条 48 字节的二进制记录
+    int idle_timeout = 15;      // --idle-timeout 秒：流多久没有包算结束
+    int active_timeout = 1800;  // --active-timeout 秒：流持续多久就先导出一次
+};
+
+capture_options parse_capture_options(int argc, char **argv)
+{
+    capture_options options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--read" && i + 1 < argc)
+        {
+            options.read_file = argv[++i];
+        }
+        else if (arg == "--max-speed")
+        {
+            options.max_speed = true;
+        }
+        else if (arg == "--quiet")
+        {
+            options.quiet = true;
+        }
+        else if (arg == "--workers" && i + 1 < argc)
+        {
+            options.workers = atoi(argv[++i]);
+        }
+        else if (arg == "--interface" && i + 1 < argc)
+        {
+            options.interface = argv[++i];
+        }
+        else if (arg == "--backend" && i + 1 < argc)
+        {
+            options.backend = argv[++i];
+        }
+        else if (arg == "--top" && i + 1 < argc)
+        {
+            options.top = atoi(argv[++i]);
+        }
+        else if (arg == "--query" && i + 1 < argc)
+        {
+            options.queries.push_back(argv[++i]);
+        }
+        else if (arg == "--flows" && i + 1 < argc)
+        {
+            options.flows = argv[++i];
+        }
+        else if (arg == "--flow-format" && i + 1 < argc)
+        {
+            options.flow_csv = std::string(argv[++i]) != "binary";
+        }
+        else if (arg == "--idle-timeout" && i + 1 < argc)
+        {
+            options.idle_timeout = atoi(argv[++i]);
+        }
+        else if (arg == "--active-timeout" && i + 1 < argc)
+        {
+            options.active_timeout = atoi(argv[++i]);
+        }
+    }
+    if (options.workers <= 0)
+    {
+        // 留一个核给抓包线程
+        int cores = (int)std::thread::hardware_concurrency();
+        options.workers = cores > 2 ? cores - 1 : 1;
+    }
+    return options;
+}
+
+// 列出网卡让用户选一个，打开后返回；失败返回 nullptr
+pcap_t *open_interface(char *errorBuffer)
+{
+    pcap_if_t *interfaces, *temp;
+
+    // 获取所有网卡
+    if (pcap_findalldevs(&interfaces, errorBuffer) == -1 || interfaces == nullptr)
+    {
+        printf("没找到网卡\n");
+        return nullptr;
+    }
+
+    // 显示所有设备
+    printf("网卡：\n");
+    int i = 0;
+    for (temp = interfaces; temp; temp = temp->next)
+    {
+        printf("#%d: %s - %s\n", ++i, temp->name, temp->description ? temp->description : "");
+    }
+
+    fflush(stdout);
+
+    temp = interfaces;
+    // 不推荐用虚拟网卡
+    int targetIndex = 1;
+    if (scanf("%d", &targetIndex) != 1)
+    {
+        targetIndex = 1;
+    }
+
+    for (i = 1; i < targetIndex; i++)
+    {
+        if (temp->next != nullptr)
+        {
+            temp = temp->next;
+        }
+    }
+
+    // 打开接口
+    pcap_t *handle = pcap_open_live(temp->name, BUFSIZ, 1, 1000, errorBuffer);
+    if (handle == nullptr)
+    {
+        printf("打不开 %s: %s\n", temp->name, errorBuffer);
+    }
+    else
+    {
+        printf("侦听数据流 %s...\n", temp->name);
+    }
+
+    fflush(stdout);
+    pcap_freealldevs(interfaces);
+    return handle;
+}
+
+// 按选项打开抓包来源：给了 --read 就打开抓包文件，给了 --interface 就打开这块网卡，否则交互选择网卡
+pcap_t *open_capture(const capture_options &options, char *errorBuffer)
+{
+    if (options.read_file.empty() && !options.interface.empty())
+    {
+        pcap_t *handle = pcap_open_live(options.interface.c_str(), BUFSIZ, 1, 1000, errorBuffer);
+        if (handle == nullptr)
+        {
+            printf("打不开 %s: %s\n", options.interface.c_str(), errorBuffer);
+            return nullptr;
+        }
+        printf("侦听数据流 %s...\n", options.interface.c_str());
+        fflush(stdout);
+        return handle;
+    }
+    if (options.read_file.empty())
+    {
+        return open_interface(errorBuffer);
+    }
+
+    pcap_t *handle = pcap_open_offline(options.read_file.c_str(), errorBuffer);
+    if (handle == nullptr)
+    {
+        printf("打不开 %s: %s\n", options.read_file.c_str(), errorBuffer);
+        return nullptr;
+    }
+    printf("回放 %s%s...\n", options.read_file.c_str(), options.max_speed ? "（不限速）" : "");
+    fflush(stdout);
+    return handle;
+}
+
+// 输出 libpcap 的收包和丢包计数；回放文件时没有这些统计，什么都不输出
+void print_capture_stats(pcap_t *handle)
+{
+    pcap_stat stats;
+    if (handle == nullptr || pcap_stats(handle, &stats) != 0)
+    {
+        return;
+    }
+    printf("收到 %u 个包，缓冲区满丢弃 %u 个，网卡丢弃 %u 个\n", stats.ps_recv, stats.ps_drop, stats.ps_ifdrop);
+}
+
+// 回放时按包的时间戳间隔等待，还原抓包时的速率
+struct replay_state
+{
+    pcap_handler handler = nullptr;
+    u_char *param = nullptr;
+    bool paced = false;
+    bool started = false;
+    timeval first_ts{};
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t packets = 0;
+};
+
+void replay_handler(u_char *param, const pcap_pkthdr *header, const u_char *pkt_data)
+{
+    auto *state = (replay_state *)param;
+    if (!state->started)
+    {
+        state->started = true;
+        state->first_ts = header->ts;
+        state->start_time = std::chrono::steady_clock::now();
+    }
+    else if (state->paced)
+    {
+        auto offset = std::chrono::seconds(header->ts.tv_sec - state->first_ts.tv_sec) +
+                      std::chrono::microseconds(header->ts.tv_usec - state->first_ts.tv_usec);
+        std::this_thread::sleep_until(state->start_time + offset);
+    }
+    state->packets++;
+    state->handler(state->param, header, pkt_data);
+}
+
+// Ctrl-C 或 SIGTERM 时置位，抓包循环看到后退出，之后照常做最后一次报告、导出流、写完日志
+std::atomic<bool> stop_requested{false};
+// 用 pcap 抓包时让 pcap_loop 返回
+pcap_t *stop_handle;
+
+void on_stop_signal(int sig)
+{
+    stop_requested.store(true, std::memory_order_relaxed);
+    if (stop_handle)
+    {
+        pcap_breakloop(stop_handle);
+    }
+    // 收尾卡住时再按一次 Ctrl-C 直接结束
+    std::signal(sig, SIG_DFL);
+}
+
+// handle 为正在抓包的句柄，AF_PACKET 没有句柄时传 nullptr，由各线程自己检查 stop_requested
+void install_stop_handler(pcap_t *handle = nullptr)
+{
+    stop_handle = handle;
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+}
+
+// 跑完整个抓包来源；回放文件时结束后输出处理速率，可以用来测 packet_handler 的吞吐
+int run_capture(pcap_t *handle, const capture_options &options, pcap_handler handler, u_char *param = nullptr)
+{
+    if (options.read_file.empty())
+    {
+        return pcap_loop(handle, 0, handler, param);
+    }
+
+    replay_state state;
+    state.handler = handler;
+    state.param = param;
+    state.paced = !options.max_speed;
+    state.start_time = std::chrono::steady_clock::now();
+    int res = pcap_loop(handle, 0, replay_handler, (u_char *)&state);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - state.start_time).count();
+    printf("回放结束：%llu 个包，用时 %.3f 秒", (unsigned long long)state.packets, seconds);
+    if (seconds > 0)
+    {
+        printf("，%.0f 包/秒", state.packets / seconds);
+    }
+    printf("\n");
+    fflush(stdout);
+    return res;
+}
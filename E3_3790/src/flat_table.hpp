@@ -0,0 +1,222 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 一个地址的流量计数，64 位不会像 u_int 那样到 4 GB 就回绕
+struct traffic_counter
+{
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+
+    void add(uint64_t len)
+    {
+        bytes += len;
+        packets++;
+    }
+
+    traffic_counter &operator+=(const traffic_counter &other)
+    {
+        bytes += other.bytes;
+        packets += other.packets;
+        return *this;
+    }
+};
+
+// MAC 地址按大端拼进 uint64_t 的低 48 位，当哈希表的键
+inline uint64_t mac_to_key(const uint8_t *mac)
+{
+    return (uint64_t)mac[0] << 40 | (uint64_t)mac[1] << 32 | (uint64_t)mac[2] << 24 |
+           (uint64_t)mac[3] << 16 | (uint64_t)mac[4] << 8 | (uint64_t)mac[5];
+}
+
+inline std::array<uint8_t, 6> key_to_mac(uint64_t key)
+{
+    return {(uint8_t)(key >> 40), (uint8_t)(key >> 32), (uint8_t)(key >> 24),
+            (uint8_t)(key >> 16), (uint8_t)(key >> 8), (uint8_t)key};
+}
+
+// IPv6 地址当哈希表的键：16 字节按网络字节序原样拷进来，可以直接交给 inet_ntop
+struct ipv6_key
+{
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const ipv6_key &) const = default;
+};
+
+// 整数键直接参与 Fibonacci 哈希
+inline uint64_t hash_key(uint64_t key)
+{
+    return key;
+}
+
+// IPv6 地址两半先混成 64 位；按小端读成整数后，同一前缀下的地址只有 lo 的高位不同，再把高 32 位折到低位，乘法时能影响到结果的高位
+inline uint64_t hash_key(const ipv6_key &key)
+{
+    uint64_t x = key.hi * 0xC2B2AE3D27D4EB4FULL ^ key.lo;
+    return x ^ x >> 32;
+}
+
+// 扁平哈希表：键用 hash_key 哈希，开放寻址 + 线性探测，所有槽位在一块连续内存里
+// 查找一般只碰一两条缓存行，插入不分配节点；装载率超过一半时容量翻倍
+template <typename Key, typename Value>
+class FlatTable
+{
+public:
+    explicit FlatTable(size_t capacity = 1024)
+    {
+        size_t n = 16;
+        while (n < capacity)
+        {
+            n <<= 1;
+        }
+        resize(n);
+    }
+
+    // 找到键对应的值，没有就插入一个默认值
+    Value &operator[](Key key)
+    {
+        size_t i = index_of(key);
+        while (slots[i].used)
+        {
+            if (slots[i].key == key)
+            {
+                return slots[i].value;
+            }
+            i = (i + 1) & mask;
+        }
+
+        if ((count + 1) * 2 > slots.size())
+        {
+            grow();
+            return (*this)[key];
+        }
+        slots[i].used = true;
+        slots[i].key = key;
+        count++;
+        return slots[i].value;
+    }
+
+    // 没有这个键返回 nullptr
+    Value *find(Key key)
+    {
+        return const_cast<Value *>(static_cast<const FlatTable *>(this)->find(key));
+    }
+
+    const Value *find(Key key) const
+    {
+        for (size_t i = index_of(key); slots[i].used; i = (i + 1) & mask)
+        {
+            if (slots[i].key == key)
+            {
+                return &slots[i].value;
+            }
+        }
+        return nullptr;
+    }
+
+    // 删除一个键；线性探测删除后把后面同一串的槽位往前挪，不需要墓碑
+    bool erase(Key key)
+    {
+        size_t i = index_of(key);
+        while (slots[i].used && slots[i].key != key)
+        {
+            i = (i + 1) & mask;
+        }
+        if (!slots[i].used)
+        {
+            return false;
+        }
+
+        size_t hole = i;
+        for (size_t j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask)
+        {
+            // j 的理想位置不在 (hole, j] 之间时，才能挪到 hole 上
+            size_t home = index_of(slots[j].key);
+            if (((j - home) & mask) >= ((j - hole) & mask))
+            {
+                slots[hole] = slots[j];
+                hole = j;
+            }
+        }
+        slots[hole] = Slot();
+        count--;
+        return true;
+    }
+
+    // 遍历所有键值对，顺序不固定
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (const Slot &slot : slots)
+        {
+            if (slot.used)
+            {
+                f(slot.key, slot.value);
+            }
+        }
+    }
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    void clear()
+    {
+        for (Slot &slot : slots)
+        {
+            slot = Slot();
+        }
+        count = 0;
+    }
+
+private:
+    struct Slot
+    {
+        Key key{};
+        bool used = false;
+        Value value{};
+    };
+
+    // Fibonacci 哈希：乘上 2^64 / 黄金分割比后取高位，连续的地址也能打散
+    size_t index_of(Key key) const
+    {
+        return (size_t)((hash_key(key) * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    // 容量必须是 2 的幂
+    void resize(size_t n)
+    {
+        slots.assign(n, Slot());
+        mask = n - 1;
+        shift = 64;
+        for (size_t i = n; i > 1; i >>= 1)
+        {
+            shift--;
+        }
+        count = 0;
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old;
+        old.swap(slots);
+        resize(old.size() * 2);
+        for (const Slot &slot : old)
+        {
+            if (slot.used)
+            {
+                (*this)[slot.key] = slot.value;
+            }
+        }
+    }
+
+    std::vector<Slot> slots;
+    size_t mask = 0;
+    int shift = 64;
+    size_t count = 0;
+};
@@ -0,0 +1,410 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+
+// 五元组，地址和端口都是网络字节序；不是 TCP/UDP 的包端口为 0
+struct flow_key
+{
+    uint32_t src_ip;
+    uint32_t dst_ip;
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint8_t proto;
+};
+
+// 流结束的原因
+enum flow_end_reason : uint8_t
+{
+    FLOW_IDLE = 1,              // 超过空闲超时没有包
+    FLOW_ACTIVE = 2,            // 持续时间超过活动超时，导出后下一个包重新开始一条流
+    FLOW_END = 3,               // 抓包结束
+};
+
+// 导出的一条流，字段和 NetFlow v5 的记录差不多；二进制导出时按这个布局原样写出，每条 48 字节
+struct flow_record
+{
+    int64_t first_us;           // 第一个包的时间，微秒
+    int64_t last_us;            // 最后一个包的时间
+    uint64_t bytes;
+    uint64_t packets;
+    uint32_t src_ip;            // 网络字节序
+    uint32_t dst_ip;
+    uint16_t src_port;          // 网络字节序
+    uint16_t dst_port;
+    uint8_t proto;
+    uint8_t tcp_flags;          // 所有包的 TCP 标志按位或
+    uint8_t end_reason;         // flow_end_reason
+    uint8_t reserved;
+};
+static_assert(sizeof(flow_record) == 48);
+
+// 单向流表：按五元组统计包数和字节数，不存包本身
+// 开放寻址 + 线性探测，每条流正好占一条缓存行；删除留墓碑，墓碑多了就原地重建
+// 超时用两级时间轮：第一级 256 格每格 1 秒，第二级 64 格每格 256 秒，到了第二级的格子再下放到第一级
+// 收包时只改流的时间，不动时间轮；到点时按最后一个包的时间重新算，还没到期就重新登记
+class FlowTable
+{
+public:
+    // idle_timeout、active_timeout 单位为秒
+    FlowTable(int64_t idle_timeout, int64_t active_timeout, size_t capacity = 1 << 16)
+        : idle_timeout(idle_timeout), active_timeout(active_timeout), level0(LEVEL0, NIL), level1(LEVEL1, NIL)
+    {
+        size_t n = 16;
+        while (n < capacity)
+        {
+            n <<= 1;
+        }
+        resize(n);
+    }
+
+    // 记一个包，ts_us 为包的时间（微秒）；时间走过的这段里到期的流交给 on_expire(const flow_record &)
+    template <typename F>
+    void add(const flow_key &key, int64_t ts_us, uint32_t len, uint8_t tcp_flags, F on_expire)
+    {
+        advance(ts_us / 1000000, on_expire);
+
+        entry &flow = slots[find_or_insert(key, ts_us)];
+        if (ts_us > flow.last_us)
+        {
+            flow.last_us = ts_us;
+        }
+        flow.bytes += len;
+        flow.packets++;
+        flow.tcp_flags |= tcp_flags;
+    }
+
+    // 时间前进到 sec 秒，到期的流交给 on_expire
+    template <typename F>
+    void advance(int64_t sec, F on_expire)
+    {
+        if (now < 0)
+        {
+            now = sec;
+            return;
+        }
+        if (sec - now > LEVEL0 * LEVEL1)
+        {
+            // 跳得太远，一格一格走不如直接扫一遍整个表
+            now = sec;
+            for (size_t i = 0; i < slots.size(); i++)
+            {
+                if (slots[i].state == USED && deadline(slots[i]) <= now)
+                {
+                    expire(i, on_expire);
+                }
+            }
+            rebuild_wheel();
+            return;
+        }
+        while (now < sec)
+        {
+            now++;
+            if ((now & (LEVEL0 - 1)) == 0)
+            {
+                // 新的 256 秒开始，把第二级里属于这一段的流下放到第一级
+                uint32_t i = take(level1[(now >> LEVEL0_BITS) & (LEVEL1 - 1)]);
+                while (i != NIL)
+                {
+                    uint32_t next = slots[i].timer_next;
+                    schedule(i);
+                    i = next;
+                }
+            }
+
+            uint32_t i = take(level0[now & (LEVEL0 - 1)]);
+            while (i != NIL)
+            {
+                uint32_t next = slots[i].timer_next;
+                if (deadline(slots[i]) <= now)
+                {
+                    expire(i, on_expire);
+                }
+                else
+                {
+                    schedule(i);
+                }
+                i = next;
+            }
+        }
+    }
+
+    // 抓包结束时导出所有还没结束的流，然后清空
+    template <typename F>
+    void flush(F on_expire)
+    {
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].state == USED)
+            {
+                on_expire(to_record(slots[i], FLOW_END));
+            }
+        }
+        resize(slots.size());
+    }
+
+    // 当前的流数
+    size_t size() const
+    {
+        return count;
+    }
+
+private:
+    static constexpr uint32_t NIL = UINT32_MAX;
+    static constexpr int LEVEL0_BITS = 8;
+    static constexpr int64_t LEVEL0 = 1 << LEVEL0_BITS;
+    static constexpr int64_t LEVEL1 = 64;
+
+    enum slot_state : uint8_t
+    {
+        EMPTY = 0,
+        USED = 1,
+        DELETED = 2,
+    };
+
+    struct alignas(64) entry
+    {
+        int64_t first_us;
+        int64_t last_us;
+        uint64_t bytes;
+        uint64_t packets;
+        uint32_t src_ip;
+        uint32_t dst_ip;
+        uint16_t src_port;
+        uint16_t dst_port;
+        uint8_t proto;
+        uint8_t tcp_flags;
+        uint8_t state;
+        uint32_t timer_next;    // 时间轮同一格里的下一条流
+    };
+    static_assert(sizeof(entry) == 64);
+
+    static bool matches(const entry &flow, const flow_key &key)
+    {
+        return flow.src_ip == key.src_ip && flow.dst_ip == key.dst_ip && flow.src_port == key.src_port &&
+               flow.dst_port == key.dst_port && flow.proto == key.proto;
+    }
+
+    size_t index_of(const flow_key &key) const
+    {
+        uint64_t h = ((uint64_t)key.src_ip << 32 | key.dst_ip) * 0x9E3779B97F4A7C15ULL;
+        h ^= ((uint64_t)key.src_port << 24 | (uint64_t)key.dst_port << 8 | key.proto) * 0xC2B2AE3D27D4EB4FULL;
+        h ^= h >> 29;
+        return (size_t)((h * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    size_t find_or_insert(const flow_key &key, int64_t ts_us)
+    {
+        size_t i = index_of(key);
+        size_t tombstone = SIZE_MAX;
+        for (; slots[i].state != EMPTY; i = (i + 1) & mask)
+        {
+            if (slots[i].state == USED && matches(slots[i], key))
+            {
+                return i;
+            }
+            if (slots[i].state == DELETED && tombstone == SIZE_MAX)
+            {
+                tombstone = i;
+            }
+        }
+
+        if (tombstone != SIZE_MAX)
+        {
+            i = tombstone;
+            deleted--;
+        }
+        else if ((count + deleted + 1) * 2 > slots.size())
+        {
+            rehash(count * 4 > slots.size() ? slots.size() * 2 : slots.size());
+            return find_or_insert(key, ts_us);
+        }
+
+        entry &flow = slots[i];
+        flow = entry();
+        flow.first_us = ts_us;
+        flow.last_us = ts_us;
+        flow.src_ip = key.src_ip;
+        flow.dst_ip = key.dst_ip;
+        flow.src_port = key.src_port;
+        flow.dst_port = key.dst_port;
+        flow.proto = key.proto;
+        flow.state = USED;
+        count++;
+        schedule((uint32_t)i);
+        return i;
+    }
+
+    // 空闲超时和活动超时中先到的那个（秒）
+    int64_t deadline(const entry &flow) const
+    {
+        int64_t idle = flow.last_us / 1000000 + idle_timeout + 1;
+        int64_t active = flow.first_us / 1000000 + active_timeout;
+        return idle < active ? idle : active;
+    }
+
+    // 按流现在的到期时间登记到时间轮：256 秒内的进第一级，更远的进第二级，超出第二级一圈的先登记在最远处
+    // 已经过期的（包的时间落后于按当前时间推进的表）登记到下一秒，当前这一格已经走过了
+    void schedule(uint32_t i)
+    {
+        int64_t when = deadline(slots[i]);
+        if (when <= now)
+        {
+            when = now + 1;
+        }
+        uint32_t *head;
+        if (when - now < LEVEL0)
+        {
+            head = &level0[when & (LEVEL0 - 1)];
+        }
+        else
+        {
+            if (when - now >= LEVEL0 * (LEVEL1 - 1))
+            {
+                when = now + LEVEL0 * (LEVEL1 - 1) - 1;
+            }
+            head = &level1[(when >> LEVEL0_BITS) & (LEVEL1 - 1)];
+        }
+        slots[i].timer_next = *head;
+        *head = i;
+    }
+
+    static uint32_t take(uint32_t &head)
+    {
+        uint32_t res = head;
+        head = NIL;
+        return res;
+    }
+
+    template <typename F>
+    void expire(size_t i, F on_expire)
+    {
+        entry &flow = slots[i];
+        bool active = now >= flow.first_us / 1000000 + active_timeout;
+        on_expire(to_record(flow, active ? FLOW_ACTIVE : FLOW_IDLE));
+        flow.state = DELETED;
+        count--;
+        deleted++;
+    }
+
+    static flow_record to_record(const entry &flow, flow_end_reason reason)
+    {
+        return flow_record{flow.first_us, flow.last_us, flow.bytes, flow.packets, flow.src_ip, flow.dst_ip,
+                           flow.src_port, flow.dst_port, flow.proto, flow.tcp_flags, (uint8_t)reason, 0};
+    }
+
+    // 容量必须是 2 的幂
+    void resize(size_t n)
+    {
+        slots.assign(n, entry());
+        mask = n - 1;
+        shift = 64;
+        for (size_t i = n; i > 1; i >>= 1)
+        {
+            shift--;
+        }
+        count = 0;
+        deleted = 0;
+        std::fill(level0.begin(), level0.end(), NIL);
+        std::fill(level1.begin(), level1.end(), NIL);
+    }
+
+    // 换到 n 个槽位并去掉墓碑；流换了位置，时间轮整个重建
+    void rehash(size_t n)
+    {
+        std::vector<entry> old;
+        old.swap(slots);
+        resize(n);
+        for (const entry &flow : old)
+        {
+            if (flow.state != USED)
+            {
+                continue;
+            }
+            size_t i = index_of(flow_key{flow.src_ip, flow.dst_ip, flow.src_port, flow.dst_port, flow.proto});
+            while (slots[i].state != EMPTY)
+            {
+                i = (i + 1) & mask;
+            }
+            slots[i] = flow;
+            count++;
+        }
+        rebuild_wheel();
+    }
+
+    void rebuild_wheel()
+    {
+        std::fill(level0.begin(), level0.end(), NIL);
+        std::fill(level1.begin(), level1.end(), NIL);
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].state == USED)
+            {
+                schedule((uint32_t)i);
+            }
+        }
+    }
+
+    int64_t idle_timeout;
+    int64_t active_timeout;
+    std::vector<entry> slots;
+    size_t mask = 0;
+    int shift = 64;
+    size_t count = 0;
+    size_t deleted = 0;
+    std::vector<uint32_t> level0;
+    std::vector<uint32_t> level1;
+    int64_t now = -1;           // 时间轮走到的秒
+};
+
+// 秒数转成本地时间的字符串；报告线程和主线程都会导出流，日志写线程也在转时间，不能用 localtime 的静态缓冲区
+inline void format_local_time(char *out, size_t size, time_t sec)
+{
+    tm timeInfo;
+#ifdef _WIN32
+    localtime_s(&timeInfo, &sec);
+#else
+    localtime_r(&sec, &timeInfo);
+#endif
+    strftime(out, size, "%Y-%m-%d %H:%M:%S", &timeInfo);
+}
+
+// 把流记录写进导出文件：csv 为 false 时原样写出 48 字节的 flow_record，否则每条一行 CSV
+inline void write_flows(FILE *file, bool csv, const flow_record *records, size_t n)
+{
+    if (!csv)
+    {
+        fwrite(records, sizeof(flow_record), n, file);
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+        const flow_record &record = records[i];
+        char first[32], last[32], src[16], dst[16];
+        format_local_time(first, sizeof(first), (time_t)(record.first_us / 1000000));
+        format_local_time(last, sizeof(last), (time_t)(record.last_us / 1000000));
+        inet_ntop(AF_INET, &record.src_ip, src, sizeof(src));
+        inet_ntop(AF_INET, &record.dst_ip, dst, sizeof(dst));
+        fprintf(file, "%s.%06d,%s.%06d,%s,%u,%s,%u,%u,%llu,%llu,%u,%u\n", first, (int)(record.first_us % 1000000), last,
+                (int)(record.last_us % 1000000), src, ntohs(record.src_port), dst, ntohs(record.dst_port), record.proto,
+                (unsigned long long)record.packets, (unsigned long long)record.bytes, record.tcp_flags, record.end_reason);
+    }
+}
+
+// CSV 导出文件的表头
+inline void write_flow_header(FILE *file)
+{
+    fprintf(file, "开始时间,结束时间,源IP,源端口,目的IP,目的端口,协议,包数,字节数,TCP标志,结束原因\n");
+}
@@ -1,16 +1,12 @@
-#include <pcap.h>
+#include "capture.hpp"
 #include <cstdio>
 #include <ctime>
-#include <winsock2.h>
-#include <ws2tcpip.h>
 #include <map>
 #include <array>
 #include <iostream>
 #include <ostream>
 #include <sstream>
 
-#pragma comment(lib, "ws2_32.lib")
-
 // 以太网帧结构
 struct ethernet_header
 {
@@ -96,10 +92,8 @@ int parse_ftp_commands(const std::string &ftp_data)
     return 0;
 }
 
-DWORD lastPrintTime;
-
 // 回调函数：处理每个捕获的包
-void packet_handler(u_char *param, const pcap_pkthdr *header, const u_char *pkt_data)
+void packet_handler(u_char *, const pcap_pkthdr *, const u_char *pkt_data)
 {
     ethernet_header *eth_header = (ethernet_header *)(pkt_data);
     ip_header *ip_header = (struct ip_header *)(pkt_data + 4);
@@ -144,58 +138,19 @@ void packet_handler(u_char *param, const pcap_pkthdr *header, const u_char *pkt_
     }
 
 }
-int main()
+// 用法：ftp [--read file.pcap [--max-speed]]，不给 --read 时交互选择网卡
+int main(int argc, char **argv)
 {
-    pcap_if_t *interfaces, *temp;
     pcap_t *handle;
     char errorBuffer[PCAP_ERRBUF_SIZE];
 
-    // 获取所有网卡
-    pcap_findalldevs(&interfaces, errorBuffer);
-
-    // 显示所有设备
-    printf("网卡：\n");
-    int i = 0;
-    for (temp = interfaces; temp; temp = temp->next)
-    {
-        printf("#%d: %s - %s\n", ++i, temp->name, temp->description);
-    }
-
-    if (interfaces == nullptr)
-    {
-        printf("没找到网卡\n");
-        return -1;
-    }
-
-    fflush(stdout);
-
-    temp = interfaces;
-    // 不推荐用虚拟网卡
-    int targetIndex;
-    scanf("%d", &targetIndex);
-
-    for (i = 1; i < targetIndex; i++)
-    {
-        if (temp->next != nullptr)
-        {
-            temp = temp->next;
-        }
-    }
-
-    // 打开接口
-    char *selectedDevice = temp->name;
-    handle = pcap_open_live(selectedDevice, BUFSIZ, 1, 1000, errorBuffer);
+    capture_options options = parse_capture_options(argc, argv);
+    handle = open_capture(options, errorBuffer);
     if (handle == nullptr)
     {
-        printf("打不开 %s: %s\n", selectedDevice, errorBuffer);
-        pcap_freealldevs(interfaces);
         return -1;
     }
 
-    printf("侦听数据流 %s...\n", selectedDevice);
-
-    fflush(stdout);
-
     // 设置过滤器
     bpf_program fp;
     const char *filter_exp = "tcp port 21";
@@ -212,11 +167,10 @@ int main()
     }
 
     logfile = fopen("logfile.csv", "w");
-    pcap_loop(handle, 0, packet_handler, nullptr);
+    run_capture(handle, options, packet_handler);
 
     // 关闭接口
     pcap_close(handle);
-    pcap_freealldevs(interfaces);
     fclose(logfile);
     return 0;
 }
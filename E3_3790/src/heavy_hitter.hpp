@@ -0,0 +1,249 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "flat_table.hpp"
+
+// Count-Min 草图：depth 行、每行 width 个计数器，每行用不同的哈希，查询时取各行的最小值
+// 估计值不会偏小；以 1 - e^-depth 的概率，偏大不超过 e / width * 总量
+class CountMinSketch
+{
+public:
+    explicit CountMinSketch(size_t width = 2048, size_t depth = 4)
+        : width(width), depth(depth), counters(width * depth)
+    {
+    }
+
+    void add(uint64_t key, uint64_t weight)
+    {
+        for (size_t row = 0; row < depth; row++)
+        {
+            counters[row * width + column(key, row)] += weight;
+        }
+        total += weight;
+    }
+
+    uint64_t estimate(uint64_t key) const
+    {
+        uint64_t res = UINT64_MAX;
+        for (size_t row = 0; row < depth; row++)
+        {
+            res = std::min(res, counters[row * width + column(key, row)]);
+        }
+        return res;
+    }
+
+    // 同样大小的草图逐个计数器相加，相当于两边的数据合在一起统计
+    void merge(const CountMinSketch &other)
+    {
+        for (size_t i = 0; i < counters.size(); i++)
+        {
+            counters[i] += other.counters[i];
+        }
+        total += other.total;
+    }
+
+    void clear()
+    {
+        std::fill(counters.begin(), counters.end(), 0);
+        total = 0;
+    }
+
+    // 估计值偏大的上界（以 confidence() 的概率成立）
+    uint64_t error_bound() const
+    {
+        return (uint64_t)std::ceil(std::exp(1.0) / width * total);
+    }
+
+    double confidence() const
+    {
+        return 1 - std::exp(-(double)depth);
+    }
+
+    uint64_t total_weight() const
+    {
+        return total;
+    }
+
+private:
+    // 每行用不同的种子，再做一次 64 位混合（splitmix64 的终结步骤）
+    size_t column(uint64_t key, size_t row) const
+    {
+        uint64_t x = key + 0x9E3779B97F4A7C15ULL * (row + 1);
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        x ^= x >> 31;
+        return (size_t)(x % width);
+    }
+
+    size_t width;
+    size_t depth;
+    std::vector<uint64_t> counters;
+    uint64_t total = 0;
+};
+
+// Space-Saving：最多 k 个计数器，统计出现最多的 k 个键
+// 满了之后新键顶替计数最小的那个，并继承它的计数作为误差，所以真实值在 [count - error, count] 之间
+// 计数器按计数组成小根堆，更新是 O(log k)；内存和报告开销都和出现过多少个不同的键无关
+template <typename Key>
+class SpaceSaving
+{
+public:
+    struct Entry
+    {
+        Key key;
+        uint64_t count;
+        uint64_t error;
+    };
+
+    explicit SpaceSaving(size_t k = 64) : k(k), positions(k * 2) {}
+
+    void add(Key key, uint64_t weight)
+    {
+        total += weight;
+        if (uint32_t *position = positions.find(key))
+        {
+            heap[*position].count += weight;
+            sift_down(*position);
+            return;
+        }
+
+        if (heap.size() < k)
+        {
+            heap.push_back({key, weight, 0});
+            positions[key] = (uint32_t)(heap.size() - 1);
+            sift_up(heap.size() - 1);
+            return;
+        }
+
+        // 顶替计数最小的键
+        Entry &root = heap[0];
+        positions.erase(root.key);
+        root = {key, root.count + weight, root.count};
+        positions[key] = 0;
+        sift_down(0);
+    }
+
+    // 合并另一份统计（Agarwal 等人的可合并摘要）：
+    // 一边没有的键按那一边的最小计数补上（计数和误差都加），再保留最大的 k 个
+    void merge(const SpaceSaving &other)
+    {
+        uint64_t own_min = full() ? heap[0].count : 0;
+        uint64_t other_min = other.full() ? other.heap[0].count : 0;
+
+        FlatTable<Key, Entry> combined(heap.size() + other.heap.size());
+        for (const Entry &entry : heap)
+        {
+            combined[entry.key] = {entry.key, entry.count + other_min, entry.error + other_min};
+        }
+        for (const Entry &entry : other.heap)
+        {
+            Entry *existing = combined.find(entry.key);
+            if (existing)
+            {
+                existing->count += entry.count - other_min;
+                existing->error += entry.error - other_min;
+            }
+            else
+            {
+                combined[entry.key] = {entry.key, entry.count + own_min, entry.error + own_min};
+            }
+        }
+
+        std::vector<Entry> entries;
+        combined.for_each([&](Key, const Entry &entry) { entries.push_back(entry); });
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.count > b.count; });
+        if (entries.size() > k)
+        {
+            entries.resize(k);
+        }
+
+        heap.clear();
+        positions.clear();
+        for (const Entry &entry : entries)
+        {
+            heap.push_back(entry);
+            positions[entry.key] = (uint32_t)(heap.size() - 1);
+            sift_up(heap.size() - 1);
+        }
+        total += other.total;
+    }
+
+    void clear()
+    {
+        heap.clear();
+        positions.clear();
+        total = 0;
+    }
+
+    // 按计数从大到小排好的前 n 个
+    std::vector<Entry> top(size_t n) const
+    {
+        std::vector<Entry> res = heap;
+        std::sort(res.begin(), res.end(), [](const Entry &a, const Entry &b) { return a.count > b.count; });
+        if (res.size() > n)
+        {
+            res.resize(n);
+        }
+        return res;
+    }
+
+    // 任意一个键的计数误差都不超过 总量 / k
+    uint64_t error_bound() const
+    {
+        return total / k;
+    }
+
+    bool full() const
+    {
+        return heap.size() >= k;
+    }
+
+private:
+    void swap_entries(size_t a, size_t b)
+    {
+        std::swap(heap[a], heap[b]);
+        positions[heap[a].key] = (uint32_t)a;
+        positions[heap[b].key] = (uint32_t)b;
+    }
+
+    void sift_up(size_t i)
+    {
+        while (i > 0 && heap[(i - 1) / 2].count > heap[i].count)
+        {
+            swap_entries(i, (i - 1) / 2);
+            i = (i - 1) / 2;
+        }
+    }
+
+    void sift_down(size_t i)
+    {
+        while (true)
+        {
+            size_t smallest = i;
+            size_t left = 2 * i + 1, right = 2 * i + 2;
+            if (left < heap.size() && heap[left].count < heap[smallest].count)
+            {
+                smallest = left;
+            }
+            if (right < heap.size() && heap[right].count < heap[smallest].count)
+            {
+                smallest = right;
+            }
+            if (smallest == i)
+            {
+                return;
+            }
+            swap_entries(i, smallest);
+            i = smallest;
+        }
+    }
+
+    size_t k;
+    std::vector<Entry> heap;
+    FlatTable<Key, uint32_t> positions;
+    uint64_t total = 0;
+};
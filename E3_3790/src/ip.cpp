@@ -1,47 +1,183 @@
-#include <pcap.h>
+#include "capture.hpp"
+#include "flat_table.hpp"
+#include "heavy_hitter.hpp"
+#include "rate_window.hpp"
+#include "report_timer.hpp"
+#include "flow_table.hpp"
+#include "async_logger.hpp"
+#include "packet_parser.hpp"
+#include "pipeline.hpp"
+#include "afpacket.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <ctime>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#include <map>
 #include <array>
 
-#pragma comment(lib, "ws2_32.lib")
+FILE *logfile;
+AsyncLogger *logger;
+pcap_t *handle;
 
-// 以太网帧结构
-struct ethernet_header
+// --top 模式的统计：每种地址每个方向一份 Space-Saving 排出流量最大的地址，一份 Count-Min 草图回答任意地址的估计
+// Space-Saving 的计数器是 K 的 4 倍，报告只输出前 K 个；都按字节数计，大小和地址有多少个无关
+// 草图的键是 hash_key 的结果，IPv6 地址先混成 64 位
+struct heavy_hitters
 {
-    std::array<u_char, 6> dstMac;
-    std::array<u_char, 6> srcMac;
-    u_short type;
+    explicit heavy_hitters(size_t k)
+        : from_ip(k * 4), to_ip(k * 4), from_ip6(k * 4), to_ip6(k * 4), from_mac(k * 4), to_mac(k * 4) {}
+
+    void merge(const heavy_hitters &other)
+    {
+        from_ip.merge(other.from_ip);
+        to_ip.merge(other.to_ip);
+        from_ip6.merge(other.from_ip6);
+        to_ip6.merge(other.to_ip6);
+        from_mac.merge(other.from_mac);
+        to_mac.merge(other.to_mac);
+        from_ip_sketch.merge(other.from_ip_sketch);
+        to_ip_sketch.merge(other.to_ip_sketch);
+        from_ip6_sketch.merge(other.from_ip6_sketch);
+        to_ip6_sketch.merge(other.to_ip6_sketch);
+        from_mac_sketch.merge(other.from_mac_sketch);
+        to_mac_sketch.merge(other.to_mac_sketch);
+    }
+
+    void clear()
+    {
+        from_ip.clear();
+        to_ip.clear();
+        from_ip6.clear();
+        to_ip6.clear();
+        from_mac.clear();
+        to_mac.clear();
+        from_ip_sketch.clear();
+        to_ip_sketch.clear();
+        from_ip6_sketch.clear();
+        to_ip6_sketch.clear();
+        from_mac_sketch.clear();
+        to_mac_sketch.clear();
+    }
+
+    SpaceSaving<uint32_t> from_ip, to_ip;
+    SpaceSaving<ipv6_key> from_ip6, to_ip6;
+    SpaceSaving<uint64_t> from_mac, to_mac;
+    CountMinSketch from_ip_sketch, to_ip_sketch, from_ip6_sketch, to_ip6_sketch, from_mac_sketch, to_mac_sketch;
 };
 
-// IP 头结构
-struct ip_header
-{
-    u_char ver_hl;              // 版本 (4 bits) + 头长 (4 bits)
-    u_char service;             // 服务类型
-    u_short totalLen;           // 总长
-    u_short identification;     // 标识
-    u_short flags_fragOffset;   // 标志 (3 bits) + 片偏移 (13 bits)
-    u_char ttl;                 // 生存时间
-    u_char proto;               // 协议
-    u_short checksum;           // 头校验和
-    in_addr srcAddr;            // 源地址
-    in_addr dstAddr;            // 目标地址
+// --top K 和 --query，0 为精确统计
+size_t top_k;
+std::vector<std::string> queries;
+// 回放抓包文件时速率按包的时间算，实时抓包时按当前时间算
+bool replaying;
+
+// 一个工作线程在一个 epoch 里的计数增量，报告线程合并进累计值后清空
+// IPv4 地址的键是网络字节序的 s_addr，IPv6 地址的键见 ipv6_key，MAC 地址的键见 mac_to_key
+struct ip_shard
+{
+    FlatTable<uint32_t, traffic_counter> data_from_ip, data_to_ip;
+    FlatTable<ipv6_key, traffic_counter> data_from_ip6, data_to_ip6;
+    FlatTable<uint64_t, traffic_counter> data_from_mac, data_to_mac;
+    HostRates<uint32_t> rate_from_ip, rate_to_ip;
+    HostRates<ipv6_key> rate_from_ip6, rate_to_ip6;
+    std::unique_ptr<heavy_hitters> top = top_k ? std::make_unique<heavy_hitters>(top_k) : nullptr;
+    std::vector<flow_record> expired_flows;
 };
 
-struct InAddrCompare
+ShardedPipeline<ip_shard> *pipeline;
+// 从开始抓包到现在的累计计数，只有报告线程读写
+ip_shard *totals;
+
+// --flows：每个工作线程一张流表，只有它自己读写；结束的流先放进当前 epoch 的 ip_shard，由报告线程写进导出文件
+std::vector<std::unique_ptr<FlowTable>> flow_tables;
+FILE *flowfile;
+bool flow_csv;
+uint64_t exported_flows;
+
+// 按选项打开流导出文件，给每个工作线程建一张流表；没给 --flows 时什么都不做
+bool open_flow_export(const capture_options &options)
 {
-    bool operator()(const in_addr &a, const in_addr &b) const
+    if (options.flows.empty())
     {
-        return memcmp(&a, &b, sizeof(in_addr)) < 0;
+        return true;
     }
-};
+    flowfile = fopen(options.flows.c_str(), options.flow_csv ? "w" : "wb");
+    if (flowfile == nullptr)
+    {
+        printf("打不开 %s\n", options.flows.c_str());
+        return false;
+    }
+    flow_csv = options.flow_csv;
+    if (flow_csv)
+    {
+        write_flow_header(flowfile);
+    }
+    for (int i = 0; i < options.workers; i++)
+    {
+        flow_tables.push_back(std::make_unique<FlowTable>(options.idle_timeout, options.active_timeout));
+    }
+    return true;
+}
 
-FILE *logfile;
-std::map<in_addr, u_int, InAddrCompare> data_from_ip, data_to_ip;
-std::map<std::array<u_char, 6>, u_int> data_from_mac, data_to_mac;
+void export_flows(const flow_record *records, size_t n)
+{
+    write_flows(flowfile, flow_csv, records, n);
+    exported_flows += n;
+}
+
+// 工作线程都停了以后调用：把还没结束的流也导出，关闭文件
+void close_flow_export()
+{
+    if (flowfile == nullptr)
+    {
+        return;
+    }
+    for (auto &table : flow_tables)
+    {
+        table->flush([](const flow_record &record) { export_flows(&record, 1); });
+    }
+    printf("导出了 %llu 条流\n", (unsigned long long)exported_flows);
+    fclose(flowfile);
+    flowfile = nullptr;
+}
+
+// 把一个 epoch 的增量加进累计值，然后清空增量给工作线程下次用
+void fold_shard(ip_shard &total, ip_shard &delta)
+{
+    if (!delta.expired_flows.empty())
+    {
+        export_flows(delta.expired_flows.data(), delta.expired_flows.size());
+        delta.expired_flows.clear();
+    }
+
+    total.rate_from_ip.merge(delta.rate_from_ip);
+    total.rate_to_ip.merge(delta.rate_to_ip);
+    total.rate_from_ip6.merge(delta.rate_from_ip6);
+    total.rate_to_ip6.merge(delta.rate_to_ip6);
+    delta.rate_from_ip.clear();
+    delta.rate_to_ip.clear();
+    delta.rate_from_ip6.clear();
+    delta.rate_to_ip6.clear();
+
+    if (total.top)
+    {
+        total.top->merge(*delta.top);
+        delta.top->clear();
+        return;
+    }
+
+    delta.data_from_mac.for_each([&](uint64_t addr, const traffic_counter &x) { total.data_from_mac[addr] += x; });
+    delta.data_to_mac.for_each([&](uint64_t addr, const traffic_counter &x) { total.data_to_mac[addr] += x; });
+    delta.data_from_ip.for_each([&](uint32_t addr, const traffic_counter &x) { total.data_from_ip[addr] += x; });
+    delta.data_to_ip.for_each([&](uint32_t addr, const traffic_counter &x) { total.data_to_ip[addr] += x; });
+    delta.data_from_ip6.for_each([&](const ipv6_key &addr, const traffic_counter &x) { total.data_from_ip6[addr] += x; });
+    delta.data_to_ip6.for_each([&](const ipv6_key &addr, const traffic_counter &x) { total.data_to_ip6[addr] += x; });
+
+    delta.data_from_mac.clear();
+    delta.data_to_mac.clear();
+    delta.data_from_ip.clear();
+    delta.data_to_ip.clear();
+    delta.data_from_ip6.clear();
+    delta.data_to_ip6.clear();
+}
 
 // MAC 地址转字符串
 void mac_to_str(const std::array<u_char, 6> &mac, char *str)
@@ -49,141 +185,475 @@ void mac_to_str(const std::array<u_char, 6> &mac, char *str)
     sprintf(str, "%02X-%02X-%02X-%02X-%02X-%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
 }
 
-// 获取当前时间字符串
-void get_current_time(char *buffer)
+// IPv4 包按五元组记进这个工作线程的流表，端口和 TCP 标志由解析器按 IHL 读出，分片的后续片没有端口
+void track_flow(ip_shard &shard, const parsed_packet &packet, int worker)
 {
-    time_t rawTime;
-    tm *timeInfo;
-    time(&rawTime);
-    timeInfo = localtime(&rawTime);
-    strftime(buffer, 80, "%Y-%m-%d %H:%M:%S", timeInfo);
+    flow_key key{packet.src_ip4, packet.dst_ip4, packet.src_port, packet.dst_port, packet.proto};
+    int64_t ts_us = packet.ts_sec * 1000000 + packet.ts_usec;
+    flow_tables[worker]->add(key, ts_us, packet.len, packet.tcp_flags,
+                             [&](const flow_record &record) { shard.expired_flows.push_back(record); });
 }
 
-DWORD lastPrintTime;
-
-// 回调函数：处理每个捕获的包
-void packet_handler(u_char *param, const pcap_pkthdr *header, const u_char *pkt_data)
+// 实时抓包时工作线程空闲也按当前时间推进自己的流表，没有新包到这个线程，空闲的流也能按时结束
+// 回放时时间只按包的时间戳走，不调用
+void advance_flows(ip_shard &shard, int worker)
 {
-    ethernet_header *eth_header = (ethernet_header *)(pkt_data);
-    ip_header *ip_header = (struct ip_header *)(pkt_data + sizeof(struct ethernet_header));
-    char srcMac[18], dstMac[18];
-    char srcIp[16], dstIp[16];
-    char timestamp[80];
+    if (flow_tables.empty())
+    {
+        return;
+    }
+    flow_tables[worker]->advance((int64_t)time(nullptr),
+                                 [&](const flow_record &record) { shard.expired_flows.push_back(record); });
+}
 
-    // 获取时间戳
-    get_current_time(timestamp);
+// 工作线程里处理一个已经解析好的包：记日志、计数
+// ARP 等不是 IP 的包只计 MAC，IPv4 和 IPv6 各记各的表
+void process_packet(ip_shard &shard, const parsed_packet &packet, int worker)
+{
+    // 只把原始字段交给日志线程，时间用抓包的时间戳，格式化和写 CSV 都在日志线程里做
+    // 另外在运行时不要开着excel，会写失败
+    packet_record record;
+    record.ts_sec = packet.ts_sec;
+    record.ts_usec = packet.ts_usec;
+    record.len = packet.len;
+    memcpy(record.src_mac, packet.src_mac, 6);
+    memcpy(record.dst_mac, packet.dst_mac, 6);
+    if (packet.l3 == L3_IPV4)
+    {
+        record.ip_version = 4;
+        memcpy(record.src_ip, &packet.src_ip4, 4);
+        memcpy(record.dst_ip, &packet.dst_ip4, 4);
+    }
+    else if (packet.l3 == L3_IPV6)
+    {
+        record.ip_version = 6;
+        memcpy(record.src_ip, &packet.src_ip6, 16);
+        memcpy(record.dst_ip, &packet.dst_ip6, 16);
+    }
+    else
+    {
+        record.ip_version = 0;
+    }
+    logger->log(record, worker);
 
-    // 解析以太网头
-    mac_to_str(eth_header->srcMac, srcMac);
-    mac_to_str(eth_header->dstMac, dstMac);
+    if (!flow_tables.empty() && packet.l3 == L3_IPV4)
+    {
+        track_flow(shard, packet, worker);
+    }
 
-    // 获取源和目标 IP 地址
-    inet_ntop(AF_INET, &(ip_header->srcAddr), srcIp, sizeof(srcIp));
-    inet_ntop(AF_INET, &(ip_header->dstAddr), dstIp, sizeof(dstIp));
+    // 速率窗口两种模式都记
+    if (packet.l3 == L3_IPV4)
+    {
+        shard.rate_from_ip.add(packet.src_ip4, packet.ts_sec, packet.len);
+        shard.rate_to_ip.add(packet.dst_ip4, packet.ts_sec, packet.len);
+    }
+    else if (packet.l3 == L3_IPV6)
+    {
+        shard.rate_from_ip6.add(packet.src_ip6, packet.ts_sec, packet.len);
+        shard.rate_to_ip6.add(packet.dst_ip6, packet.ts_sec, packet.len);
+    }
 
-    printf("%s,%s,%s,%s,%s,%d\n", timestamp, srcMac, srcIp, dstMac, dstIp, header->len);
-    fflush(stdout);
-    // 记录到 CSV 日志，另外在运行时不要开着excel，会写失败
-    fprintf(logfile, "%s,%s,%s,%s,%s,%d\n", timestamp, srcMac, srcIp, dstMac, dstIp, header->len);
+    uint64_t srcMac = mac_to_key(packet.src_mac);
+    uint64_t dstMac = mac_to_key(packet.dst_mac);
+    if (shard.top)
+    {
+        shard.top->from_mac.add(srcMac, packet.len);
+        shard.top->to_mac.add(dstMac, packet.len);
+        shard.top->from_mac_sketch.add(srcMac, packet.len);
+        shard.top->to_mac_sketch.add(dstMac, packet.len);
+        if (packet.l3 == L3_IPV4)
+        {
+            shard.top->from_ip.add(packet.src_ip4, packet.len);
+            shard.top->to_ip.add(packet.dst_ip4, packet.len);
+            shard.top->from_ip_sketch.add(packet.src_ip4, packet.len);
+            shard.top->to_ip_sketch.add(packet.dst_ip4, packet.len);
+        }
+        else if (packet.l3 == L3_IPV6)
+        {
+            shard.top->from_ip6.add(packet.src_ip6, packet.len);
+            shard.top->to_ip6.add(packet.dst_ip6, packet.len);
+            shard.top->from_ip6_sketch.add(hash_key(packet.src_ip6), packet.len);
+            shard.top->to_ip6_sketch.add(hash_key(packet.dst_ip6), packet.len);
+        }
+        return;
+    }
 
     // 统计数据长度
-    data_from_mac[eth_header->srcMac] += header->len;
-    data_to_mac[eth_header->dstMac] += header->len;
+    shard.data_from_mac[srcMac].add(packet.len);
+    shard.data_to_mac[dstMac].add(packet.len);
 
-    data_from_ip[ip_header->srcAddr] += header->len;
-    data_to_ip[ip_header->dstAddr] += header->len;
+    if (packet.l3 == L3_IPV4)
+    {
+        shard.data_from_ip[packet.src_ip4].add(packet.len);
+        shard.data_to_ip[packet.dst_ip4].add(packet.len);
+    }
+    else if (packet.l3 == L3_IPV6)
+    {
+        shard.data_from_ip6[packet.src_ip6].add(packet.len);
+        shard.data_to_ip6[packet.dst_ip6].add(packet.len);
+    }
+}
 
-    // 定时输出来自/发至不同 MAC 和 IP 地址的通信数据长度
-    auto currentTime = GetTickCount();
-    if (currentTime - lastPrintTime > 10000)
-        {
-            for (auto [addr, x]: data_from_mac)
-            {
-                mac_to_str(addr, srcMac);
-                printf("来自%s的数据长度为%d\n", srcMac, x);
-            }
+// 输出一个方向流量最大的前 top_k 个地址：Space-Saving 的计数是上界，减去误差是下界，草图的估计也是上界，取两者中小的
+template <typename Key, typename Format>
+void print_top(const char *title, const SpaceSaving<Key> &summary, const CountMinSketch &sketch, Format format)
+{
+    char address[INET6_ADDRSTRLEN];
+    printf("%s流量最大的 %zu 个（共 %llu 字节，排名误差不超过 %llu 字节，草图以 %.0f%% 的概率多估不超过 %llu 字节）：\n",
+           title, top_k, (unsigned long long)sketch.total_weight(), (unsigned long long)summary.error_bound(),
+           sketch.confidence() * 100, (unsigned long long)sketch.error_bound());
+    int rank = 0;
+    for (const auto &entry : summary.top(top_k))
+    {
+        format(entry.key, address);
+        uint64_t upper = std::min(entry.count, sketch.estimate(hash_key(entry.key)));
+        printf("#%d %s 的数据长度为 %llu ~ %llu\n", ++rank, address, (unsigned long long)(entry.count - entry.error),
+               (unsigned long long)upper);
+    }
+}
 
-            for (auto [addr, x]: data_to_mac)
-            {
-                mac_to_str(addr, dstMac);
-                printf("发至%s的数据长度为%d\n", dstMac, x);
-            }
+// 解析 --query 给的 MAC 地址，字节之间用 - 或 : 分隔
+bool parse_mac(const char *str, uint64_t &key)
+{
+    unsigned int bytes[6];
+    char separators[5];
+    if (sscanf(str, "%2x%c%2x%c%2x%c%2x%c%2x%c%2x", &bytes[0], &separators[0], &bytes[1], &separators[1], &bytes[2],
+               &separators[2], &bytes[3], &separators[3], &bytes[4], &separators[4], &bytes[5]) != 11)
+    {
+        return false;
+    }
+    uint8_t mac[6];
+    for (int i = 0; i < 6; i++)
+    {
+        mac[i] = (uint8_t)bytes[i];
+    }
+    key = mac_to_key(mac);
+    return true;
+}
 
-            for (auto [addr, x]: data_from_ip)
-            {
-                inet_ntop(AF_INET, &addr, srcIp, sizeof(srcIp));
-                printf("来自%s的数据长度为%d\n", srcIp, x);
-            }
+// 各主机最近 10 秒、60 秒、5 分钟的速率，精确统计和 --top 模式都输出
+void print_rates(ip_shard &total)
+{
+    char srcIp[INET6_ADDRSTRLEN], dstIp[INET6_ADDRSTRLEN];
 
-            for (auto [addr, x]: data_to_ip)
-            {
-                inet_ntop(AF_INET, &addr, dstIp, sizeof(dstIp));
-                printf("发至%s的数据长度为%d\n", dstIp, x);
-            }
+    // 当前时间取回放到的最新的包；实时抓包时取现在，链路空闲时也照样回收不活跃的主机
+    int64_t now;
+    if (replaying)
+    {
+        now = std::max({total.rate_from_ip.clock(), total.rate_to_ip.clock(), total.rate_from_ip6.clock(),
+                        total.rate_to_ip6.clock()});
+    }
+    else
+    {
+        now = (int64_t)time(nullptr);
+        total.rate_from_ip.advance(now);
+        total.rate_to_ip.advance(now);
+        total.rate_from_ip6.advance(now);
+        total.rate_to_ip6.advance(now);
+    }
 
-            fflush(stdout);
+    // 最近 10 秒、60 秒、5 分钟的平均速率，只列出这段时间里有流量的主机
+    auto print_rate = [](const char *direction, const char *addr, const host_rate &rate)
+    {
+        printf("%s%s最近 10 秒 %.0f 字节/秒 %.1f 包/秒，60 秒 %.0f 字节/秒 %.1f 包/秒，5 分钟 %.0f 字节/秒 %.1f 包/秒\n",
+               direction, addr, rate.bytes_per_sec[0], rate.packets_per_sec[0], rate.bytes_per_sec[1],
+               rate.packets_per_sec[1], rate.bytes_per_sec[2], rate.packets_per_sec[2]);
+    };
+    total.rate_from_ip.for_each(now, [&](uint32_t addr, const host_rate &rate)
+    {
+        inet_ntop(AF_INET, &addr, srcIp, sizeof(srcIp));
+        print_rate("来自", srcIp, rate);
+    });
+    total.rate_to_ip.for_each(now, [&](uint32_t addr, const host_rate &rate)
+    {
+        inet_ntop(AF_INET, &addr, dstIp, sizeof(dstIp));
+        print_rate("发至", dstIp, rate);
+    });
+    total.rate_from_ip6.for_each(now, [&](const ipv6_key &addr, const host_rate &rate)
+    {
+        inet_ntop(AF_INET6, &addr, srcIp, sizeof(srcIp));
+        print_rate("来自", srcIp, rate);
+    });
+    total.rate_to_ip6.for_each(now, [&](const ipv6_key &addr, const host_rate &rate)
+    {
+        inet_ntop(AF_INET6, &addr, dstIp, sizeof(dstIp));
+        print_rate("发至", dstIp, rate);
+    });
+}
 
-            lastPrintTime = currentTime;
+// --top 模式的报告：只输出前 K 个和 --query 指定地址的估计，开销和地址有多少个无关
+void print_top_report()
+{
+    heavy_hitters &total = *totals->top;
+
+    auto format_mac = [](uint64_t key, char *str) { mac_to_str(key_to_mac(key), str); };
+    auto format_ip = [](uint32_t key, char *str) { inet_ntop(AF_INET, &key, str, INET6_ADDRSTRLEN); };
+    auto format_ip6 = [](const ipv6_key &key, char *str) { inet_ntop(AF_INET6, &key, str, INET6_ADDRSTRLEN); };
+    print_top("源 MAC ", total.from_mac, total.from_mac_sketch, format_mac);
+    print_top("目的 MAC ", total.to_mac, total.to_mac_sketch, format_mac);
+    print_top("源 IP ", total.from_ip, total.from_ip_sketch, format_ip);
+    print_top("目的 IP ", total.to_ip, total.to_ip_sketch, format_ip);
+    print_top("源 IPv6 ", total.from_ip6, total.from_ip6_sketch, format_ip6);
+    print_top("目的 IPv6 ", total.to_ip6, total.to_ip6_sketch, format_ip6);
+
+    for (const std::string &query : queries)
+    {
+        in_addr addr;
+        ipv6_key addr6;
+        uint64_t mac;
+        if (inet_pton(AF_INET, query.c_str(), &addr) == 1)
+        {
+            printf("%s：来自它的数据长度约为 %llu，发至它的约为 %llu\n", query.c_str(),
+                   (unsigned long long)total.from_ip_sketch.estimate(addr.s_addr),
+                   (unsigned long long)total.to_ip_sketch.estimate(addr.s_addr));
+        }
+        else if (inet_pton(AF_INET6, query.c_str(), &addr6) == 1)
+        {
+            printf("%s：来自它的数据长度约为 %llu，发至它的约为 %llu\n", query.c_str(),
+                   (unsigned long long)total.from_ip6_sketch.estimate(hash_key(addr6)),
+                   (unsigned long long)total.to_ip6_sketch.estimate(hash_key(addr6)));
+        }
+        else if (parse_mac(query.c_str(), mac))
+        {
+            printf("%s：来自它的数据长度约为 %llu，发至它的约为 %llu\n", query.c_str(),
+                   (unsigned long long)total.from_mac_sketch.estimate(mac),
+                   (unsigned long long)total.to_mac_sketch.estimate(mac));
         }
+        else
+        {
+            printf("%s：不是 IP 或 MAC 地址\n", query.c_str());
+        }
+    }
+    print_rates(*totals);
+
+    if (flowfile)
+    {
+        printf("已导出 %llu 条流\n", (unsigned long long)exported_flows);
+    }
+    print_capture_stats(handle);
+    fflush(stdout);
 }
-int main()
+
+// 在报告线程里调用：收走各工作线程上一个 epoch 的增量，输出来自/发至不同 MAC 和 IP 地址的通信数据长度
+void print_report()
 {
-    pcap_if_t *interfaces, *temp;
-    pcap_t *handle;
-    char errorBuffer[PCAP_ERRBUF_SIZE];
+    pipeline->collect([](ip_shard &delta) { fold_shard(*totals, delta); });
+    if (top_k)
+    {
+        print_top_report();
+        return;
+    }
+
+    char srcMac[18], dstMac[18];
+    char srcIp[INET6_ADDRSTRLEN], dstIp[INET6_ADDRSTRLEN];
+
+    ip_shard &total = *totals;
+
+    total.data_from_mac.for_each([&](uint64_t addr, const traffic_counter &x)
+    {
+        mac_to_str(key_to_mac(addr), srcMac);
+        printf("来自%s的数据长度为%llu，共%llu个包\n", srcMac, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
 
-    // 获取所有网卡
-    pcap_findalldevs(&interfaces, errorBuffer);
+    total.data_to_mac.for_each([&](uint64_t addr, const traffic_counter &x)
+    {
+        mac_to_str(key_to_mac(addr), dstMac);
+        printf("发至%s的数据长度为%llu，共%llu个包\n", dstMac, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
+
+    total.data_from_ip.for_each([&](uint32_t addr, const traffic_counter &x)
+    {
+        inet_ntop(AF_INET, &addr, srcIp, sizeof(srcIp));
+        printf("来自%s的数据长度为%llu，共%llu个包\n", srcIp, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
 
-    // 显示所有设备
-    printf("网卡：\n");
-    int i = 0;
-    for (temp = interfaces; temp; temp = temp->next)
+    total.data_to_ip.for_each([&](uint32_t addr, const traffic_counter &x)
     {
-        printf("#%d: %s - %s\n", ++i, temp->name, temp->description);
+        inet_ntop(AF_INET, &addr, dstIp, sizeof(dstIp));
+        printf("发至%s的数据长度为%llu，共%llu个包\n", dstIp, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
+
+    total.data_from_ip6.for_each([&](const ipv6_key &addr, const traffic_counter &x)
+    {
+        inet_ntop(AF_INET6, &addr, srcIp, sizeof(srcIp));
+        printf("来自%s的数据长度为%llu，共%llu个包\n", srcIp, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
+
+    total.data_to_ip6.for_each([&](const ipv6_key &addr, const traffic_counter &x)
+    {
+        inet_ntop(AF_INET6, &addr, dstIp, sizeof(dstIp));
+        printf("发至%s的数据长度为%llu，共%llu个包\n", dstIp, (unsigned long long)x.bytes, (unsigned long long)x.packets);
+    });
+
+    print_rates(total);
+
+    if (flowfile)
+    {
+        printf("已导出 %llu 条流\n", (unsigned long long)exported_flows);
     }
+    print_capture_stats(handle);
+    fflush(stdout);
+}
+
+// 回调函数：抓包线程只解析包头，把解析结果交给工作线程，定时报告在单独的线程里
+void packet_handler(u_char *, const pcap_pkthdr *header, const u_char *pkt_data)
+{
+    pipeline->submit(header->ts.tv_sec, header->ts.tv_usec, header->len, pkt_data, header->caplen);
+}
 
-    if (interfaces == nullptr)
+#ifdef __linux__
+// AF_PACKET 后端：每个工作线程读自己的内存环，整块交给自己的分片处理，不经过抓包线程
+int run_afpacket(const capture_options &options)
+{
+    if (options.interface.empty())
     {
-        printf("没找到网卡\n");
+        printf("AF_PACKET 抓包需要用 --interface 指定网卡\n");
         return -1;
     }
 
+    // 同一个进程的环加入同一个 fanout 组
+    int group = getpid() & 0xffff;
+    char errorBuffer[256];
+    uint32_t blocks = AfPacketRing::blocks_per_ring(options.workers);
+    std::vector<std::unique_ptr<AfPacketRing>> rings;
+    for (int i = 0; i < options.workers; i++)
+    {
+        rings.push_back(std::make_unique<AfPacketRing>());
+        if (!rings.back()->open(options.interface.c_str(), group, blocks, errorBuffer, sizeof(errorBuffer)))
+        {
+            printf("打不开 %s: %s\n", options.interface.c_str(), errorBuffer);
+            return -1;
+        }
+    }
+    printf("侦听数据流 %s（AF_PACKET，%d 个线程）...\n", options.interface.c_str(), options.workers);
     fflush(stdout);
 
-    temp = interfaces;
-    // 不推荐用虚拟网卡
-    int targetIndex;
-    scanf("%d", &targetIndex);
+    if (!open_flow_export(options))
+    {
+        return -1;
+    }
+    logfile = fopen("logfile.csv", "w");
+    logger = new AsyncLogger(logfile, !options.quiet, options.workers);
+    pipeline = new ShardedPipeline<ip_shard>(options.workers, process_packet, advance_flows, false);
+    totals = new ip_shard();
+
+    // 收到 Ctrl-C 后各线程最多一个 poll 超时内退出，再走下面的收尾
+    install_stop_handler();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < options.workers; i++)
+    {
+        threads.emplace_back([&rings, i]()
+        {
+            // 每次等待结束都确认一次 epoch，链路空闲时报告线程最多等一个 poll 超时
+            while (!stop_requested.load(std::memory_order_relaxed) &&
+                   rings[i]->poll_blocks([i](const packet_view *packets, size_t n) { pipeline->process_batch(i, packets, n); }, 100) >= 0)
+            {
+                pipeline->checkpoint(i);
+            }
+            pipeline->finish(i);
+        });
+    }
 
-    for (i = 1; i < targetIndex; i++)
+    // 定时输出，同时汇总各个环的收包和丢包
+    uint64_t received = 0, dropped = 0;
+    ReportTimer timer(std::chrono::seconds(10), [&]()
     {
-        if (temp->next != nullptr)
+        print_report();
+        for (auto &ring : rings)
         {
-            temp = temp->next;
+            uint64_t packets, drops;
+            if (ring->stats(packets, drops))
+            {
+                received += packets;
+                dropped += drops;
+            }
         }
+        printf("收到 %llu 个包，环满丢弃 %llu 个\n", (unsigned long long)received, (unsigned long long)dropped);
+        fflush(stdout);
+    });
+
+    for (std::thread &thread : threads)
+    {
+        thread.join();
     }
+    timer.stop();
+    print_report();
+    close_flow_export();
 
-    // 打开接口
-    char *selectedDevice = temp->name;
-    handle = pcap_open_live(selectedDevice, BUFSIZ, 1, 1000, errorBuffer);
-    if (handle == nullptr)
+    logger->stop();
+    if (logger->dropped_count())
     {
-        printf("打不开 %s: %s\n", selectedDevice, errorBuffer);
-        pcap_freealldevs(interfaces);
-        return -1;
+        printf("日志队列满，丢弃了 %llu 条记录\n", (unsigned long long)logger->dropped_count());
     }
+    delete totals;
+    delete pipeline;
+    delete logger;
+    fclose(logfile);
 
-    printf("侦听数据流 %s...\n", selectedDevice);
+    return 0;
+}
+#endif
 
-    fflush(stdout);
+// 用法：ip [--read file.pcap [--max-speed]] [--interface 网卡名] [--backend pcap|afpacket] [--quiet] [--workers N]
+//          [--top K [--query 地址]...] [--flows 文件 [--flow-format csv|binary] [--idle-timeout 秒] [--active-timeout 秒]]
+// 不给 --read 和 --interface 时交互选择网卡
+int main(int argc, char **argv)
+{
+    char errorBuffer[PCAP_ERRBUF_SIZE];
+
+    capture_options options = parse_capture_options(argc, argv);
+    top_k = options.top > 0 ? options.top : 0;
+    queries = options.queries;
+    replaying = !options.read_file.empty();
+    if (options.backend == "afpacket")
+    {
+#ifdef __linux__
+        return run_afpacket(options);
+#else
+        printf("AF_PACKET 抓包只有 Linux 支持\n");
+        return -1;
+#endif
+    }
+    handle = open_capture(options, errorBuffer);
+    if (handle == nullptr)
+    {
+        return -1;
+    }
 
+    if (!open_flow_export(options))
+    {
+        return -1;
+    }
     logfile = fopen("logfile.csv", "w");
-    pcap_loop(handle, 0, packet_handler, nullptr);
+    logger = new AsyncLogger(logfile, !options.quiet, options.workers);
+    pipeline = new ShardedPipeline<ip_shard>(options.workers, process_packet, replaying ? nullptr : advance_flows);
+    totals = new ip_shard();
+    ReportTimer timer(std::chrono::seconds(10), print_report);
+    // 实时抓包时 pcap_loop 不会自己返回，Ctrl-C 让它返回后照常收尾，还在流表里的流也能导出
+    install_stop_handler(handle);
+    run_capture(handle, options, packet_handler);
+
+    // 处理完剩下的包，最后再报告一次
+    timer.stop();
+    pipeline->stop();
+    print_report();
+    close_flow_export();
+    if (pipeline->queue_waits())
+    {
+        printf("工作线程来不及处理，抓包线程等待了 %llu 次\n", (unsigned long long)pipeline->queue_waits());
+    }
 
     // 关闭接口
     pcap_close(handle);
-    pcap_freealldevs(interfaces);
+    logger->stop();
+    if (logger->dropped_count())
+    {
+        printf("日志队列满，丢弃了 %llu 条记录\n", (unsigned long long)logger->dropped_count());
+    }
+    delete totals;
+    delete pipeline;
+    delete logger;
+    fclose(logfile);
 
     return 0;
 }
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "flat_table.hpp"
+
+// 以太网帧里 EtherType 之后的三层协议
+enum l3_kind : uint8_t
+{
+    L3_OTHER = 0,               // 不认识的 EtherType，或者头不完整、字段不合法
+    L3_IPV4,
+    L3_IPV6,
+    L3_ARP,
+    L3_VLAN,                    // 802.1Q / 802.1ad 标签，只在解析过程中出现
+    L3_KINDS
+};
+
+// 解析后的包：以太网帧只在抓包线程（或 AF_PACKET 的处理线程）里解析一次，之后计数、日志、流表、选工作线程都只读这里的字段
+// 地址和端口保持网络字节序；没有的字段为 0。整个结构 96 字节，比原来队列里带 112 字节包头的描述还小
+struct parsed_packet
+{
+    int64_t ts_sec;
+    int32_t ts_usec;
+    uint32_t len;               // 包在线路上的原始长度
+    uint32_t caplen;            // 实际抓到的字节数，三层和四层头的偏移都不超过它
+    uint16_t ether_type;        // 剥掉 VLAN 标签之后的 EtherType（主机字节序）
+    uint16_t vlan;              // 最外层 VLAN ID，没有标签为 0
+    uint8_t src_mac[6];
+    uint8_t dst_mac[6];
+    l3_kind l3;
+    uint8_t proto;              // IPv4 的协议号，IPv6 跳过扩展头之后的下一个头
+    uint8_t tcp_flags;
+    bool has_ports;             // 是 TCP/UDP 的首片，端口读到了
+    bool fragment;              // IP 分片的后续片，没有四层头
+    bool truncated;             // 快照长度不够，有的头没读全
+    uint16_t l3_offset;         // 三层头在帧里的偏移
+    uint16_t l4_offset;         // 四层头的偏移，IPv4 按 IHL 算，IPv6 跳过扩展头；没有四层头为 0
+    uint16_t payload_offset;    // 负载的偏移，可能超过 caplen，说明负载没抓到
+    uint16_t src_port;
+    uint16_t dst_port;
+    uint32_t src_ip4;
+    uint32_t dst_ip4;
+    ipv6_key src_ip6;
+    ipv6_key dst_ip6;
+};
+
+namespace packet_parser_detail
+{
+    constexpr uint32_t ETH_HEADER = 14;
+    constexpr int MAX_VLAN_TAGS = 2;
+    constexpr int MAX_IPV6_EXTENSIONS = 4;
+
+    inline uint16_t read_be16(const uint8_t *p)
+    {
+        return (uint16_t)(p[0] << 8 | p[1]);
+    }
+
+    // EtherType 分发表：高低字节异或作下标，认识的几种 EtherType 落在不同的格子里，查一次再比一次类型就知道是哪种
+    struct ethertype_slot
+    {
+        uint16_t type = 0;
+        l3_kind kind = L3_OTHER;
+    };
+
+    constexpr uint8_t ethertype_index(uint16_t type)
+    {
+        return (uint8_t)(type ^ type >> 8);
+    }
+
+    struct ethertype_table
+    {
+        ethertype_slot slots[256];
+
+        constexpr ethertype_table() : slots()
+        {
+            const ethertype_slot known[] = {
+                {0x0800, L3_IPV4}, {0x86DD, L3_IPV6}, {0x0806, L3_ARP},
+                {0x8100, L3_VLAN}, {0x88A8, L3_VLAN}, {0x9100, L3_VLAN},
+            };
+            for (const ethertype_slot &slot : known)
+            {
+                slots[ethertype_index(slot.type)] = slot;
+            }
+        }
+    };
+
+    inline constexpr ethertype_table ETHERTYPES;
+
+    inline l3_kind ether_kind(uint16_t type)
+    {
+        const ethertype_slot &slot = ETHERTYPES.slots[ethertype_index(type)];
+        return slot.type == type ? slot.kind : L3_OTHER;
+    }
+
+    // TCP/UDP 的端口、TCP 标志和负载偏移，分片的后续片不调用；扩展头已经超出 caplen 时四层偏移留 0
+    inline void parse_l4(const uint8_t *data, uint32_t caplen, uint32_t l4, parsed_packet &packet)
+    {
+        if (caplen < l4)
+        {
+            packet.truncated = true;
+            return;
+        }
+        packet.l4_offset = (uint16_t)l4;
+        packet.payload_offset = (uint16_t)l4;
+        if (packet.proto != 6 && packet.proto != 17)
+        {
+            return;
+        }
+        if (caplen < l4 + 4)
+        {
+            packet.truncated = true;
+            return;
+        }
+        memcpy(&packet.src_port, data + l4, 2);
+        memcpy(&packet.dst_port, data + l4 + 2, 2);
+        packet.has_ports = true;
+
+        if (packet.proto == 17)
+        {
+            packet.payload_offset = (uint16_t)(l4 + 8);
+        }
+        else if (caplen >= l4 + 14)
+        {
+            packet.tcp_flags = data[l4 + 13];
+            packet.payload_offset = (uint16_t)(l4 + (data[l4 + 12] >> 4) * 4);
+        }
+        else
+        {
+            packet.truncated = true;
+        }
+    }
+
+    inline void parse_ipv4(const uint8_t *data, uint32_t caplen, parsed_packet &packet)
+    {
+        uint32_t offset = packet.l3_offset;
+        if (caplen < offset + 20)
+        {
+            packet.truncated = true;
+            return;
+        }
+        const uint8_t *ip = data + offset;
+        uint32_t ihl = (ip[0] & 0x0f) * 4;
+        if ((ip[0] >> 4) != 4 || ihl < 20)
+        {
+            return;
+        }
+        packet.l3 = L3_IPV4;
+        packet.proto = ip[9];
+        memcpy(&packet.src_ip4, ip + 12, 4);
+        memcpy(&packet.dst_ip4, ip + 16, 4);
+
+        // 片偏移不为 0 的后续片没有四层头；选项没抓全时也不往后读
+        packet.fragment = (read_be16(ip + 6) & 0x1fff) != 0;
+        if (caplen < offset + ihl)
+        {
+            packet.truncated = true;
+            return;
+        }
+        if (!packet.fragment)
+        {
+            parse_l4(data, caplen, offset + ihl, packet);
+        }
+    }
+
+    inline void parse_ipv6(const uint8_t *data, uint32_t caplen, parsed_packet &packet)
+    {
+        uint32_t offset = packet.l3_offset;
+        if (caplen < offset + 40)
+        {
+            packet.truncated = true;
+            return;
+        }
+        const uint8_t *ip = data + offset;
+        if ((ip[0] >> 4) != 6)
+        {
+            return;
+        }
+        packet.l3 = L3_IPV6;
+        memcpy(&packet.src_ip6, ip + 8, 16);
+        memcpy(&packet.dst_ip6, ip + 24, 16);
+
+        // 跳过逐跳选项、路由、目的选项和分片扩展头，找到四层协议
+        uint8_t next = ip[6];
+        uint32_t l4 = offset + 40;
+        for (int i = 0; i < MAX_IPV6_EXTENSIONS && (next == 0 || next == 43 || next == 60 || next == 44); i++)
+        {
+            if (caplen < l4 + 8)
+            {
+                packet.truncated = true;
+                packet.proto = next;
+                return;
+            }
+            if (next == 44)
+            {
+                packet.fragment = (read_be16(data + l4 + 2) & 0xfff8) != 0;
+                next = data[l4];
+                l4 += 8;
+            }
+            else
+            {
+                next = data[l4];
+                l4 += (data[l4 + 1] + 1) * 8;
+            }
+        }
+        packet.proto = next;
+        if (!packet.fragment)
+        {
+            parse_l4(data, caplen, l4, packet);
+        }
+    }
+
+    // ARP 和不认识的协议只留下以太网头的字段，不会被当成 IP 包计数
+    inline void parse_arp(const uint8_t *, uint32_t, parsed_packet &packet)
+    {
+        packet.l3 = L3_ARP;
+    }
+
+    inline void parse_none(const uint8_t *, uint32_t, parsed_packet &)
+    {
+    }
+
+    using l3_parser = void (*)(const uint8_t *, uint32_t, parsed_packet &);
+
+    // 按 l3_kind 分发到各协议的解析函数；VLAN 在进来之前已经剥掉了
+    inline constexpr l3_parser L3_PARSERS[L3_KINDS] = {parse_none, parse_ipv4, parse_ipv6, parse_arp, parse_none};
+}
+
+// 解析以太网帧的各层头，填进 packet 里除时间戳和 len 以外的字段；每次读之前都按 caplen 检查，不会越界
+// 最多剥两层 VLAN 标签（QinQ），再多就当作不认识的协议
+inline void parse_packet(const uint8_t *data, uint32_t caplen, parsed_packet &packet)
+{
+    using namespace packet_parser_detail;
+
+    packet.caplen = caplen;
+    packet.ether_type = 0;
+    packet.vlan = 0;
+    packet.l3 = L3_OTHER;
+    packet.proto = 0;
+    packet.tcp_flags = 0;
+    packet.has_ports = false;
+    packet.fragment = false;
+    packet.truncated = false;
+    packet.l3_offset = packet.l4_offset = packet.payload_offset = 0;
+    packet.src_port = packet.dst_port = 0;
+    packet.src_ip4 = packet.dst_ip4 = 0;
+    packet.src_ip6 = packet.dst_ip6 = ipv6_key();
+
+    if (caplen < ETH_HEADER)
+    {
+        memset(packet.dst_mac, 0, 6);
+        memset(packet.src_mac, 0, 6);
+        packet.truncated = true;
+        return;
+    }
+    memcpy(packet.dst_mac, data, 6);
+    memcpy(packet.src_mac, data + 6, 6);
+
+    uint32_t offset = 12;
+    uint16_t type = read_be16(data + offset);
+    l3_kind kind = ether_kind(type);
+    for (int tags = 0; kind == L3_VLAN; tags++)
+    {
+        if (tags == MAX_VLAN_TAGS || caplen < offset + 6)
+        {
+            packet.truncated = caplen < offset + 6;
+            packet.ether_type = type;
+            packet.l3_offset = (uint16_t)(offset + 2);
+            return;
+        }
+        if (tags == 0)
+        {
+            packet.vlan = read_be16(data + offset + 2) & 0x0fff;
+        }
+        offset += 4;
+        type = read_be16(data + offset);
+        kind = ether_kind(type);
+    }
+    packet.ether_type = type;
+    packet.l3_offset = (uint16_t)(offset + 2);
+    L3_PARSERS[kind](data, caplen, packet);
+}
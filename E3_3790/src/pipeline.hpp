@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "packet_parser.hpp"
+#include "spsc_ring.hpp"
+
+// AF_PACKET 环里的一个包：指向包头数据，数据直接在 AF_PACKET 的环形缓冲区里，处理线程解析后交给分片
+struct packet_view
+{
+    int64_t ts_sec;
+    int32_t ts_usec;
+    uint32_t caplen;            // data 里有效的字节数
+    uint32_t len;               // 包在线路上的原始长度
+    const uint8_t *data;
+};
+
+// 解析 AF_PACKET 环里的一个包，时间戳和长度从环里的包头拿
+inline void parse_view(const packet_view &view, parsed_packet &packet)
+{
+    packet.ts_sec = view.ts_sec;
+    packet.ts_usec = view.ts_usec;
+    packet.len = view.len;
+    parse_packet(view.data, view.caplen, packet);
+}
+
+// 选工作线程用的哈希，和网卡的 RSS 类似：IPv4 和 IPv6 包按源和目的地址，其余按两个 MAC
+// 源和目的异或后再哈希，同一对主机两个方向的包落在同一个工作线程
+inline uint32_t shard_hash(const parsed_packet &packet)
+{
+    uint64_t key;
+    if (packet.l3 == L3_IPV4)
+    {
+        key = packet.src_ip4 ^ packet.dst_ip4;
+    }
+    else if (packet.l3 == L3_IPV6)
+    {
+        key = hash_key(packet.src_ip6) ^ hash_key(packet.dst_ip6);
+    }
+    else
+    {
+        key = mac_to_key(packet.src_mac) ^ mac_to_key(packet.dst_mac);
+    }
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+// 分片并行处理：抓包线程解析包头，把解析结果放进某个工作线程的队列，按地址哈希选队列
+// 每个工作线程独占两份 Shard（计数表等），按 epoch 的奇偶轮流写其中一份，处理包时不加锁
+// 报告线程调用 collect 切换 epoch，等工作线程都换到另一份之后，读走上一份里的增量并清空
+// process(shard, packet, worker) 在工作线程里调用，worker 是工作线程的序号
+// idle(shard, worker) 在工作线程没有包可处理时调用，可以为空
+template <typename Shard>
+class ShardedPipeline
+{
+public:
+    using process_fn = void (*)(Shard &, const parsed_packet &, int);
+    using idle_fn = void (*)(Shard &, int);
+
+    // queued 为 false 时不建队列和工作线程，由调用方自己的线程调用 process_batch（如 AF_PACKET 每个线程读自己的 socket）
+    ShardedPipeline(int workers, process_fn process, idle_fn idle = nullptr, bool queued = true,
+                    size_t queue_capacity = 1 << 14)
+        : process(process), idle(idle)
+    {
+        for (int i = 0; i < workers; i++)
+        {
+            shards.push_back(std::make_unique<Worker>(queued ? queue_capacity : 2));
+        }
+        for (int i = 0; queued && i < workers; i++)
+        {
+            shards[i]->thread = std::thread([this, i]() { run(i); });
+        }
+    }
+
+    ~ShardedPipeline()
+    {
+        stop();
+    }
+
+    // 抓包线程调用；队列满了就等工作线程腾出位置，来不及处理的包会积压到内核缓冲区里，由 pcap_stats 统计丢包
+    // 包头在这里解析一次，工作线程只读解析结果
+    void submit(int64_t ts_sec, int32_t ts_usec, uint32_t len, const uint8_t *data, uint32_t caplen)
+    {
+        parsed_packet packet;
+        packet.ts_sec = ts_sec;
+        packet.ts_usec = ts_usec;
+        packet.len = len;
+        parse_packet(data, caplen, packet);
+
+        Worker &worker = *shards[shard_hash(packet) % shards.size()];
+        while (!worker.queue.try_push(packet))
+        {
+            waits++;
+            std::this_thread::yield();
+        }
+    }
+
+    // 不经过队列，直接在调用线程里解析并处理第 worker 个分片的一批包
+    void process_batch(int worker, const packet_view *packets, size_t n)
+    {
+        Worker &target = *shards[worker];
+        // 一批开始时读一次 epoch，整批写进同一份计数，处理完再确认
+        uint64_t current = epoch.load(std::memory_order_acquire);
+        Shard &shard = target.shard[current & 1];
+        parsed_packet packet;
+        for (size_t i = 0; i < n; i++)
+        {
+            parse_view(packets[i], packet);
+            process(shard, packet, worker);
+        }
+        target.seen.store(current, std::memory_order_release);
+    }
+
+    // 自己调用 process_batch 的线程没有包可处理时也要定期调用，确认已经不再写上一个 epoch 的那份，顺便调用 idle
+    void checkpoint(int worker)
+    {
+        Worker &target = *shards[worker];
+        uint64_t current = epoch.load(std::memory_order_acquire);
+        if (idle)
+        {
+            idle(target.shard[current & 1], worker);
+        }
+        target.seen.store(current, std::memory_order_release);
+    }
+
+    // 处理线程退出前调用，之后 collect 不再等它确认
+    void finish(int worker)
+    {
+        shards[worker]->seen.store(UINT64_MAX, std::memory_order_release);
+    }
+
+    // 报告线程调用：切换到下一个 epoch，等每个工作线程确认后，把它上一个 epoch 写的那份交给 f
+    // f 把里面的增量合并走并清空，下下个 epoch 工作线程接着用这份；等待的只有报告线程，处理包的线程不用等
+    template <typename F>
+    void collect(F f)
+    {
+        std::lock_guard<std::mutex> lock(collect_mutex);
+        uint64_t previous = epoch.fetch_add(1, std::memory_order_acq_rel);
+        for (auto &worker : shards)
+        {
+            while (worker->seen.load(std::memory_order_acquire) <= previous)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            f(worker->shard[previous & 1]);
+        }
+    }
+
+    // 处理完队列里剩下的包后结束工作线程
+    void stop()
+    {
+        running.store(false, std::memory_order_release);
+        for (auto &worker : shards)
+        {
+            if (worker->thread.joinable())
+            {
+                worker->thread.join();
+            }
+        }
+    }
+
+    int worker_count() const
+    {
+        return (int)shards.size();
+    }
+
+    // 抓包线程因为队列满而等待的次数
+    uint64_t queue_waits() const
+    {
+        return waits;
+    }
+
+private:
+    static constexpr size_t BATCH = 256;
+
+    struct Worker
+    {
+        explicit Worker(size_t capacity) : queue(capacity) {}
+
+        SpscRing<parsed_packet> queue;
+        Shard shard[2];
+        // 最近确认过的 epoch，单独放一条缓存行，报告线程轮询它不影响计数
+        alignas(64) std::atomic<uint64_t> seen{0};
+        std::thread thread;
+    };
+
+    void run(int index)
+    {
+        Worker &worker = *shards[index];
+        std::vector<parsed_packet> batch(BATCH);
+        while (true)
+        {
+            bool stopping = !running.load(std::memory_order_acquire);
+            size_t n = worker.queue.pop_batch(batch.data(), BATCH);
+
+            // 没有包时也走一遍，顺便确认 epoch，报告线程不用等到来包
+            uint64_t current = epoch.load(std::memory_order_acquire);
+            Shard &shard = worker.shard[current & 1];
+            for (size_t i = 0; i < n; i++)
+            {
+                process(shard, batch[i], index);
+            }
+            if (n == 0 && idle)
+            {
+                idle(shard, index);
+            }
+            worker.seen.store(current, std::memory_order_release);
+            if (n == 0)
+            {
+                if (stopping)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+        finish(index);
+    }
+
+    process_fn process;
+    idle_fn idle;
+    std::vector<std::unique_ptr<Worker>> shards;
+    std::atomic<bool> running{true};
+    std::atomic<uint64_t> epoch{0};
+    std::mutex collect_mutex;
+    uint64_t waits = 0;
+};
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "flat_table.hpp"
+
+// 一个主机最近几分钟的流量，按时间分桶放在环里：最近 64 秒每秒一个桶，最近 320 秒每 10 秒一个桶
+// 包的时间只往前走，走到新的桶时把环里已经过期的旧桶清零，所以每个包的更新是 O(1)
+struct rate_buckets
+{
+    static constexpr int64_t SECONDS = 64;
+    static constexpr int64_t TENS = 32;
+
+    // 一秒内一个主机的字节数不会超过 4 GB，每秒的桶用 32 位省一半内存
+    struct second_bucket
+    {
+        uint32_t bytes;
+        uint32_t packets;
+    };
+
+    second_bucket seconds[SECONDS];
+    traffic_counter tens[TENS];
+    int64_t last_sec;           // 最近一个包所在的秒
+
+    void reset(int64_t sec)
+    {
+        for (second_bucket &bucket : seconds)
+        {
+            bucket = {0, 0};
+        }
+        for (traffic_counter &bucket : tens)
+        {
+            bucket = traffic_counter();
+        }
+        last_sec = sec;
+    }
+
+    // 时间前进到 sec，中间走过的旧桶清零
+    void roll(int64_t sec)
+    {
+        if (sec <= last_sec)
+        {
+            return;
+        }
+        for (int64_t s = last_sec + 1; s <= sec && s <= last_sec + SECONDS; s++)
+        {
+            seconds[s & (SECONDS - 1)] = {0, 0};
+        }
+        for (int64_t t = last_sec / 10 + 1; t <= sec / 10 && t <= last_sec / 10 + TENS; t++)
+        {
+            tens[t & (TENS - 1)] = traffic_counter();
+        }
+        last_sec = sec;
+    }
+
+    void add(int64_t sec, uint32_t len)
+    {
+        if (sec > last_sec)
+        {
+            roll(sec);
+        }
+        else if (last_sec - sec >= SECONDS)
+        {
+            // 乱序太久的包已经没有桶可放
+            return;
+        }
+
+        second_bucket &bucket = seconds[sec & (SECONDS - 1)];
+        bucket.bytes += len;
+        bucket.packets++;
+        tens[(sec / 10) & (TENS - 1)].add(len);
+    }
+
+    // 把另一段时间里同一个主机的桶逐个加进来，两边都还在环里的桶才加
+    void merge(const rate_buckets &other)
+    {
+        roll(other.last_sec);
+        for (int64_t s = other.last_sec - SECONDS + 1; s <= other.last_sec; s++)
+        {
+            if (s > last_sec - SECONDS)
+            {
+                second_bucket &bucket = seconds[s & (SECONDS - 1)];
+                bucket.bytes += other.seconds[s & (SECONDS - 1)].bytes;
+                bucket.packets += other.seconds[s & (SECONDS - 1)].packets;
+            }
+        }
+        for (int64_t t = other.last_sec / 10 - TENS + 1; t <= other.last_sec / 10; t++)
+        {
+            if (t > last_sec / 10 - TENS)
+            {
+                tens[t & (TENS - 1)] += other.tens[t & (TENS - 1)];
+            }
+        }
+    }
+
+    // [now - window, now) 这 window 秒里的总流量，window 不超过 60
+    traffic_counter recent_seconds(int64_t now, int64_t window) const
+    {
+        traffic_counter res;
+        for (int64_t s = now - window; s < now; s++)
+        {
+            if (s <= last_sec && s > last_sec - SECONDS)
+            {
+                res.bytes += seconds[s & (SECONDS - 1)].bytes;
+                res.packets += seconds[s & (SECONDS - 1)].packets;
+            }
+        }
+        return res;
+    }
+
+    // now 之前完整的 window / 10 个 10 秒里的总流量，window 不超过 310
+    traffic_counter recent_tens(int64_t now, int64_t window) const
+    {
+        traffic_counter res;
+        for (int64_t t = now / 10 - window / 10; t < now / 10; t++)
+        {
+            if (t <= last_sec / 10 && t > last_sec / 10 - TENS)
+            {
+                res += tens[t & (TENS - 1)];
+            }
+        }
+        return res;
+    }
+};
+
+// 一个主机在 10 秒、60 秒、5 分钟三个窗口里的平均速率
+struct host_rate
+{
+    static constexpr int WINDOWS = 3;
+    static constexpr int64_t WINDOW_SECONDS[WINDOWS] = {10, 60, 300};
+
+    double bytes_per_sec[WINDOWS] = {};
+    double packets_per_sec[WINDOWS] = {};
+
+    host_rate &operator+=(const host_rate &other)
+    {
+        for (int i = 0; i < WINDOWS; i++)
+        {
+            bytes_per_sec[i] += other.bytes_per_sec[i];
+            packets_per_sec[i] += other.packets_per_sec[i];
+        }
+        return *this;
+    }
+
+    bool idle() const
+    {
+        return packets_per_sec[WINDOWS - 1] == 0 && packets_per_sec[0] == 0;
+    }
+};
+
+// 每个主机的滑动窗口速率，时间用包的时间戳（秒）
+// 只给最近 5 分钟里有流量的主机分配桶，桶放在池里复用；超过 5 分钟没有包的主机由时间轮回收
+// 时间轮每秒一格，主机分配时登记在它最早可能过期的那一格，到点时还活跃就按最后一个包的时间重新登记，收包时不碰时间轮
+template <typename Key>
+class HostRates
+{
+public:
+    static constexpr int64_t IDLE_TIMEOUT = 300;
+
+    HostRates() : wheel(WHEEL) {}
+
+    void add(Key key, int64_t sec, uint32_t len)
+    {
+        advance(sec);
+        uint32_t *index = hosts.find(key);
+        if (index == nullptr)
+        {
+            index = &hosts[key];
+            *index = allocate(key, sec);
+        }
+        pool[*index].buckets.add(sec, len);
+    }
+
+    // 以 now 为当前时间，对每个还有流量的主机调用 f(key, rate)
+    template <typename F>
+    void for_each(int64_t now, F f) const
+    {
+        hosts.for_each([&](Key key, uint32_t index)
+        {
+            const rate_buckets &buckets = pool[index].buckets;
+            host_rate rate;
+            for (int i = 0; i < host_rate::WINDOWS; i++)
+            {
+                int64_t window = host_rate::WINDOW_SECONDS[i];
+                traffic_counter sum = window <= 60 ? buckets.recent_seconds(now, window) : buckets.recent_tens(now, window);
+                rate.bytes_per_sec[i] = (double)sum.bytes / window;
+                rate.packets_per_sec[i] = (double)sum.packets / window;
+            }
+            if (!rate.idle())
+            {
+                f(key, rate);
+            }
+        });
+    }
+
+    // 见过的最新的包的时间，还没有包时为 -1
+    int64_t clock() const
+    {
+        return current;
+    }
+
+    // 当前分配了桶的主机数
+    size_t size() const
+    {
+        return hosts.size();
+    }
+
+    // 把另一份统计（如工作线程一个 epoch 里的增量）合并进来
+    void merge(const HostRates &other)
+    {
+        if (other.current < 0)
+        {
+            return;
+        }
+        advance(other.current);
+        other.hosts.for_each([&](Key key, uint32_t other_index)
+        {
+            const rate_buckets &buckets = other.pool[other_index].buckets;
+            uint32_t *index = hosts.find(key);
+            if (index == nullptr)
+            {
+                index = &hosts[key];
+                *index = allocate(key, buckets.last_sec);
+            }
+            pool[*index].buckets.merge(buckets);
+        });
+    }
+
+    // 清空所有主机，池和时间轮的内存留着下次用
+    void clear()
+    {
+        hosts.for_each([&](Key, uint32_t index) { free_slots.push_back(index); });
+        hosts.clear();
+        for (std::vector<uint32_t> &slot : wheel)
+        {
+            slot.clear();
+        }
+        current = -1;
+    }
+
+    // 时间前进到 sec，回收这段时间里到期的空闲主机；add 和 merge 会自动调用，链路空闲时也可以直接调用
+    // 依次处理走过的每一格，跳过超过一整圈时每格只处理一次
+    void advance(int64_t sec)
+    {
+        if (current < 0)
+        {
+            current = sec;
+            return;
+        }
+        for (int64_t t = current + 1; t <= sec && t <= current + WHEEL; t++)
+        {
+            std::vector<uint32_t> due;
+            due.swap(wheel[t & (WHEEL - 1)]);
+            for (uint32_t index : due)
+            {
+                host &entry = pool[index];
+                if (sec - entry.buckets.last_sec > IDLE_TIMEOUT)
+                {
+                    hosts.erase(entry.key);
+                    free_slots.push_back(index);
+                }
+                else
+                {
+                    schedule(index, entry.buckets.last_sec + IDLE_TIMEOUT + 1);
+                }
+            }
+            // 换回去留着容量，下一圈不用重新分配
+            if (wheel[t & (WHEEL - 1)].empty())
+            {
+                due.clear();
+                wheel[t & (WHEEL - 1)].swap(due);
+            }
+        }
+        if (sec > current)
+        {
+            current = sec;
+        }
+    }
+
+private:
+    // 比 IDLE_TIMEOUT 大，登记的时间不会绕过一整圈
+    static constexpr int64_t WHEEL = 512;
+
+    struct host
+    {
+        Key key;
+        rate_buckets buckets;
+    };
+
+    uint32_t allocate(Key key, int64_t sec)
+    {
+        uint32_t index;
+        if (free_slots.empty())
+        {
+            index = (uint32_t)pool.size();
+            pool.emplace_back();
+        }
+        else
+        {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+        pool[index].key = key;
+        pool[index].buckets.reset(sec);
+        schedule(index, sec + IDLE_TIMEOUT + 1);
+        return index;
+    }
+
+    void schedule(uint32_t index, int64_t deadline)
+    {
+        wheel[deadline & (WHEEL - 1)].push_back(index);
+    }
+
+    FlatTable<Key, uint32_t> hosts;             // 主机 -> 池里的下标
+    std::vector<host> pool;
+    std::vector<uint32_t> free_slots;
+    std::vector<std::vector<uint32_t>> wheel;
+    int64_t current = -1;
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// 定时报告线程：每隔 interval 调用一次 report，不依赖有没有包到达，链路空闲时也照常报告
+// report 比间隔还慢时跳过错过的几次，不会连着补报
+class ReportTimer
+{
+public:
+    ReportTimer(std::chrono::milliseconds interval, std::function<void()> report)
+        : interval(interval), report(std::move(report))
+    {
+        thread = std::thread([this]() { run(); });
+    }
+
+    ReportTimer(const ReportTimer &) = delete;
+    ReportTimer &operator=(const ReportTimer &) = delete;
+
+    ~ReportTimer()
+    {
+        stop();
+    }
+
+    // 不再报告；正在进行的那次报告会先做完
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+    }
+
+private:
+    void run()
+    {
+        auto next = std::chrono::steady_clock::now() + interval;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_until(lock, next, [this]() { return stopping; }))
+        {
+            lock.unlock();
+            report();
+            lock.lock();
+
+            next += interval;
+            auto now = std::chrono::steady_clock::now();
+            if (next < now)
+            {
+                next = now + interval;
+            }
+        }
+    }
+
+    std::chrono::milliseconds interval;
+    std::function<void()> report;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread thread;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// 单生产者单消费者的无锁环形队列，容量是 2 的幂
+// 生产者只写 tail、消费者只写 head，两个下标分开放在不同的缓存行，避免互相干扰
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t n = 2;
+        while (n < capacity)
+        {
+            n <<= 1;
+        }
+        items.resize(n);
+        mask = n - 1;
+    }
+
+    // 满了返回 false，不等待
+    bool try_push(const T &item)
+    {
+        size_t tail_now = tail.load(std::memory_order_relaxed);
+        if (tail_now - head_cache == items.size())
+        {
+            head_cache = head.load(std::memory_order_acquire);
+            if (tail_now - head_cache == items.size())
+            {
+                return false;
+            }
+        }
+        items[tail_now & mask] = item;
+        tail.store(tail_now + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 一次取出最多 max_count 个，返回取出的个数
+    size_t pop_batch(T *out, size_t max_count)
+    {
+        size_t head_now = head.load(std::memory_order_relaxed);
+        size_t available = tail.load(std::memory_order_acquire) - head_now;
+        size_t n = available < max_count ? available : max_count;
+        for (size_t i = 0; i < n; i++)
+        {
+            out[i] = items[(head_now + i) & mask];
+        }
+        head.store(head_now + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+    // 生产者看到的 head，只有看起来满了才重新读
+    size_t head_cache = 0;
+};